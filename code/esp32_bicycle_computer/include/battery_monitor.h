@@ -0,0 +1,51 @@
+/*
+   Battery Monitor
+   Filters the battery voltage and estimates the remaining runtime.
+
+   - Every sample is already an average of several ADC readings (oversampling, done by the caller).
+   - The samples are smoothed with an IIR low pass filter.
+   - A discharge curve (lookup table) converts the voltage into the state of charge.
+   - The runtime is calculated from the measured discharge rate. Until enough time has passed
+     for a rate to be measured, a nominal runtime for a full battery is used. It is also the upper
+     limit, so the flat middle of the discharge curve doesn't leave a rate that is too low.
+   - Below 20% the curve gets steep, new rate windows are weighted more there so the estimate
+     follows quickly near empty (checked by host_tools/battery_trace --check).
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __BATTERY_MONITOR
+#define __BATTERY_MONITOR
+
+#include <stdint.h>
+
+struct battery_struct
+{
+	// Parameters (set by battery_init())
+	double filter_factor;	  // 0..1, weight of a new sample
+	double nominal_runtime_h; // Runtime with a full battery, used until a rate was measured
+	uint32_t rate_window_ms;  // Time over which the discharge rate is measured
+
+	// State
+	bool startup; // False / 0 until the first sample
+	double voltage;	// Filtered voltage
+	double soc;		// State of charge (0..100%)
+	uint32_t window_start_ms;
+	double window_start_soc;
+	double rate; // Discharge rate (% per hour), 0 = unknown
+
+	double runtime_h; // Estimated remaining runtime
+};
+
+// Convert a reading of the reference diode (TL431) into the supply voltage
+double battery_voltage_from_reference(double ref_reading, double ref_voltage);
+
+// State of charge (0..100%) of a voltage, interpolated from the discharge curve
+double battery_soc(double voltage);
+
+void battery_init(battery_struct *b, double filter_factor, double nominal_runtime_h, uint32_t rate_window_ms);
+
+// Process a new (oversampled) voltage, now_ms is the time since boot
+void battery_update(battery_struct *b, double voltage, uint32_t now_ms);
+
+#endif
@@ -1,28 +1,69 @@
 #ifndef __COMPUTER_CONFIG
 #define __COMPUTER_CONFIG
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else // Host tools
+#include <stdint.h>
+typedef uint8_t byte;
+#endif
 
 // Optional features
 //#define 	ENABLE_OTA
 //#define 	USE_RFID
 //#define	ENABLE_TRIP_VISUALIZER
 //#define 	ENABLE_STATS_DISPLAY
+//#define	ENABLE_HISTORY_DISPLAY
+//#define	ENABLE_GPS_DIAG_DISPLAY	//Screen with the receive statistics of the GPS UART
+//#define	ENABLE_TELEMETRY		//Binary telemetry stream instead of text output on the USB serial port (see telemetry.h)
+//#define	ENABLE_TRACK_COMPRESSION	//Also log the track as compressed binary file (*.trk, see track_codec.h)
+//#define	ENABLE_GPS_AIDING	//Send the last position and the time to the GPS at boot (u-blox M8 or newer, see gps_aiding.h)
+//#define	ENABLE_PARKING		//Deep sleep while the bike is parked, wakes up on a button press (see park_enter())
+//#define	ENABLE_LOG_DECIMATION	//Only log fixes after a distance, a heading change or a time (see log_decimator.h)
 
 
 
 #define DEBUG			//Print out debug messages
+#define DEBUG_LOG_LEVEL	3		//Messages of the deferred debug log that are compiled in (0 none, 1 error, 2 warn, 3 info, 4 debug)
+#define DEBUG_LOG_INTERVAL	20	//Interval (ms) in which the debug log is printed
 #define USE_REAL_ARRAY		//GPS Path mapper uses corrent array
 #define PC_SERIAL	115200	//Serial Baud rate for connection between PC (USB to UART) and ESP32
+#define TELEMETRY_BAUD	921600	//Serial Baud rate with ENABLE_TELEMETRY
 #define MIN_NO_SAT		3	//Min number of satellites necessary for stats
 #define UTC_ADJ			2	//Adjustment for your particular time zone
 
 
 #define SD_SPEED		10		//SD Clock Speed (in MHz)
+#define LOG_ROW_SIZE	160		//Max. length of a CSV row
+#define SD_BACKLOG_SIZE	16384	//RAM buffer (bytes) for rows while the SD card is missing (~1 minute)
+#define SD_PROBE_INTERVAL	5000	//Interval (ms) in which a missing SD card is probed
+#define RIDE_INDEX_INTERVAL	60000	//Interval (ms) in which the ride index entry on the SD card is updated
+#define SPI_SD_QUEUE_LENGTH	8	//Number of SD requests (rows) the SPI bus task can queue
+#define TRACK_LZ		true	//LZ stage of the track compression (~25% smaller, ~15x more CPU time per fix)
+#define HISTORY_RIDES	4		//Number of rides shown on the history screen
 #define LCD_CONTRAST	75
+#define SCREEN_MAIN_INTERVAL	500		//Refresh interval (ms) of the main screen
+#define SCREEN_PATH_INTERVAL	1000	//Min. time (ms) between two redraws of the GPS path after it changed
+#define SCREEN_STATS_INTERVAL	2000	//Min. time (ms) between two redraws of the statistics after they changed
+#define SCREEN_DIAG_INTERVAL	1000	//Refresh interval (ms) of the GPS diagnostics screen
+#define SCREEN_STOPPED_INTERVAL	1000	//Min. refresh interval (ms) of the periodic screens while the bike stands
+#define SENSOR_PARKED_INTERVAL	10000	//Interval (ms) in which temperature and humidity are read while the bike is parked
 #define GPS_BAUD		9600
+#define GPS_RX_BUFFER	2048	//Size (bytes) of the receive ring of the GPS UART (~2s at 9600 baud, the default is 256)
+#define GPS_DIAG_INTERVAL	60000	//Interval (ms) in which the GPS receive statistics are logged
+#define GPS_AIDING_POS_MARGIN	2000	//Accuracy (m) added to the saved position for aiding (the bike may have been moved)
+#define GPS_AIDING_MAX_HDOP		5.0		//Fixes with a higher HDOP are not saved for aiding
+#define GPS_AIDING_SAVE_INTERVAL	900000	//Interval (ms) in which the saved fix is written to the flash (with ENABLE_PREFERENCES)
 #define REF_VOLTAGE		2.48	//TL431 Voltage (for calibration)
 #define REF_ADJ			1.08	//Adjustment multiplier
+#define BATTERY_SAMPLE_INTERVAL	2000	//Interval (ms) of the battery measurement
+#define BATTERY_OVERSAMPLING	16		//Number of ADC readings averaged per measurement
+#define BATTERY_FILTER			0.2		//Weight of a new measurement in the low pass filter (0..1)
+#define BATTERY_NOMINAL_RUNTIME	10.0	//Runtime (h) with a full battery, used until the discharge rate is known
+#define BATTERY_RATE_WINDOW		600000	//Time (ms) over which the discharge rate is measured
+#define PARK_WAKE_INTERVAL	3600	//Interval (s) in which the computer wakes up from deep sleep to check if the bike moves
+#define PARK_CHECK_TIME		60000	//Time (ms) the GPS gets after a timer wake-up to detect movement (the display stays off)
+#define PARK_SYNC_TIMEOUT	2000	//Max. time (ms) to wait for the SD card before the deep sleep
 
 
 #ifdef ENABLE_OTA
@@ -50,5 +91,31 @@ const byte rfid_reset = 12;
 #define LDR_DARK_VAL				700		//Higher means: turns on when it's even darker
 #define LDR_HYSTERESIS				200
 #define DARK_PWM_VAL				10
+#define LDR_SAMPLE_INTERVAL			250		//Interval (ms) in which the LDR is read
+#define LDR_FILTER_DIVIDER			4		//Low pass filter for the LDR reading (higher is slower)
+#define LDR_FADE_TIME				800		//Duration (ms) of a brightness transition
+
+// Motion classifier (moving, slow, stopped, parked, see motion.h)
+#define MOTION_SPEED_STOP			2.0		//Speed (km/h) below which the bike stops (after MOTION_STOP_TIME)
+#define MOTION_SPEED_MOVE			8.0		//Speed (km/h) above which the bike moves, in between it is slow
+#define MOTION_SPEED_HYST			1.5		//Hysteresis (km/h) of both speed thresholds
+#define MOTION_HDOP_GOOD			3.0		//Fixes change the state again once the HDOP is below this
+#define MOTION_HDOP_BAD				5.0		//Fixes with a higher HDOP don't change the state
+#define MOTION_RADIUS				10.0	//Distance (m) from the stop position that has to be exceeded to start moving (GPS jitter)
+#define MOTION_STOP_TIME			3000	//Time (ms) below MOTION_SPEED_STOP until the bike is stopped
+#define MOTION_STILL_TIME			20000	//Time (ms) without leaving MOTION_RADIUS until the bike is stopped, whatever the speed says
+#define MOTION_PARK_TIME			300000	//Time (ms) stopped until the bike is parked (with ENABLE_PARKING the computer goes to deep sleep then)
+
+// Log decimation (with ENABLE_LOG_DECIMATION, see log_decimator.h)
+#define LOG_DECIMATION_DISTANCE		50.0	//Distance (m) from the last logged fix after which a fix is logged
+#define LOG_DECIMATION_HEADING		15.0	//Heading change (degrees) since the last logged fix after which a fix is logged
+#define LOG_DECIMATION_HEADING_DISTANCE	5.0	//Min. length (m) of the segments the heading is measured over (GPS jitter)
+#define LOG_DECIMATION_MAX_INTERVAL	10000	//Max. time (ms) between two logged fixes
+
+// Climb analytics (ascent, descent and grade)
+#define CLIMB_ALT_DEADBAND			3.0		//Altitude change (m) that has to be exceeded before it counts as ascent / descent
+#define CLIMB_ALT_FILTER			0.25	//Weight of a new altitude value in the low pass filter (0..1)
+#define CLIMB_SAMPLE_SPACING		10.0	//Distance (m) between two samples of the grade window
+#define CLIMB_MIN_WINDOW			50.0	//Minimum distance (m) the grade is calculated over
 
 #endif
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+   Climb Analytics
+   Incremental ascent, descent and grade calculation.
+
+   Every fix is processed in O(1) with a fixed amount of memory:
+   - The GPS altitude is smoothed with a simple low pass filter and then run
+     through a dead band, so that noise of a few meters doesn't add up to
+     hundreds of "climbed" meters over a ride.
+   - The grade is calculated over a sliding window of samples that are spaced
+     by distance (not by time), so standing still doesn't change it.
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __CLIMB_ANALYTICS
+#define __CLIMB_ANALYTICS
+
+#include <stdint.h>
+
+#define CLIMB_WINDOW_SIZE 16 // Number of samples in the grade window
+
+struct climb_sample_struct
+{
+	double distance_m; // Travelled distance when this sample was taken
+	double altitude;   // Filtered altitude
+};
+
+struct climb_struct
+{
+	// Parameters (set by climb_init())
+	double deadband_m;	   // Altitude change that has to be exceeded before it counts
+	double filter_factor;  // 0..1, weight of a new altitude value in the low pass filter
+	double sample_spacing; // Distance between two samples in the grade window (m)
+	double min_window_m;   // Minimum window length before a grade is calculated (m)
+
+	// State
+	bool startup; // False / 0 until the first altitude was processed
+	double filtered_alt;
+	double reference_alt; // Last altitude that was counted towards ascent / descent
+
+	// Sliding window (ring buffer)
+	climb_sample_struct window[CLIMB_WINDOW_SIZE];
+	uint8_t window_head;  // Index of the newest sample
+	uint8_t window_count; // Number of valid samples
+
+	// Results
+	double total_ascent;
+	double total_descent;
+	double grade; // Percent, positive means uphill
+};
+
+// Reset all values and set the parameters
+void climb_init(climb_struct *c, double deadband_m, double filter_factor, double sample_spacing, double min_window_m);
+
+// Process a new fix
+// distance_m is the total travelled distance in meters, altitude is the raw GPS altitude
+void climb_update(climb_struct *c, double distance_m, double altitude);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+   Deferred Debug Log
+   Hot paths don't format or print anything. They push a compact event (message id plus up to
+   four integer arguments) into a lock-free ring buffer and return. A low priority task pops the
+   events, looks up the format string of the id and prints them.
+
+   - Bounded multi-producer queue (sequence number per slot), any task on any core can push
+     without a lock. There is one consumer.
+   - If the buffer is full the event is dropped and counted, a push never blocks.
+   - Levels are filtered at compile time by the LOG_* macros of the firmware, so disabled
+     messages cost nothing.
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __DEBUG_LOG
+#define __DEBUG_LOG
+
+#include <stdint.h>
+#include <atomic>
+
+#define DEBUG_LOG_LEVEL_ERROR 1
+#define DEBUG_LOG_LEVEL_WARN 2
+#define DEBUG_LOG_LEVEL_INFO 3
+#define DEBUG_LOG_LEVEL_DEBUG 4
+
+#define DEBUG_LOG_SIZE 64 // Number of events, power of two
+#define DEBUG_LOG_ARGS 4
+
+struct debug_log_event_struct
+{
+	uint32_t time_ms;
+	uint16_t id;   // Index into the format table of the firmware
+	uint8_t level; // DEBUG_LOG_LEVEL_*
+	int32_t args[DEBUG_LOG_ARGS]; // Fractional values are scaled (e.g. cm instead of m), the format names the unit
+};
+
+struct debug_log_struct
+{
+	struct
+	{
+		std::atomic<uint32_t> sequence;
+		debug_log_event_struct event;
+	} slots[DEBUG_LOG_SIZE];
+	std::atomic<uint32_t> head; // Next slot to write
+	uint32_t tail;				// Next slot to read (consumer only)
+	std::atomic<uint32_t> dropped;
+};
+
+void debug_log_init(debug_log_struct *log);
+
+// Returns false (and counts the event as dropped) if the buffer is full
+bool debug_log_push(debug_log_struct *log, uint32_t time_ms, uint8_t level, uint16_t id, int32_t a = 0, int32_t b = 0, int32_t c = 0, int32_t d = 0);
+
+// Returns false if the buffer is empty
+bool debug_log_pop(debug_log_struct *log, debug_log_event_struct *event);
+
+// Number of dropped events since the last call
+uint32_t debug_log_take_dropped(debug_log_struct *log);
+
+#endif
@@ -0,0 +1,45 @@
+/*
+   Fixed Format
+   Formats numbers with integer arithmetic instead of printf (which uses soft double math on the ESP32).
+   The text is the same as printf("%<width>.<decimals>f") byte for byte, including the rounding
+   (to nearest, exact ties to even), "-0.0" for small negative values and the padding.
+   Values that don't fit into 63 bits after scaling (and nan / inf) are passed on to snprintf.
+
+   A writer appends to a caller-supplied buffer, which always stays 0 terminated. Like snprintf,
+   length counts the characters that would have been written if the buffer is too small.
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __FIXED_FORMAT
+#define __FIXED_FORMAT
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FIXED_MAX_DECIMALS 9
+#define FIXED_PLUS 0x01		// Sign also for positive values ("%+")
+#define FIXED_ZERO_PAD 0x02 // Pad with zeros instead of spaces ("%02u", integers only)
+
+struct fixed_writer_struct
+{
+	char *buffer;
+	size_t size;
+	size_t length;
+};
+
+void fixed_writer_init(fixed_writer_struct *w, char *buffer, size_t size);
+
+// Like printf("%<width>.<decimals>f"), flags: FIXED_PLUS
+void fixed_append_double(fixed_writer_struct *w, double value, uint8_t decimals, uint8_t width, uint8_t flags);
+
+// Like printf("%<width>li"), flags: FIXED_PLUS, FIXED_ZERO_PAD
+void fixed_append_int(fixed_writer_struct *w, long value, uint8_t width, uint8_t flags);
+
+void fixed_append_text(fixed_writer_struct *w, const char *text);
+void fixed_append_char(fixed_writer_struct *w, char c);
+
+// Single value, returns the length like snprintf
+int fixed_format(char *buffer, size_t size, double value, uint8_t decimals, uint8_t width, uint8_t flags);
+
+#endif
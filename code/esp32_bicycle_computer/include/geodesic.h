@@ -0,0 +1,239 @@
+/*
+   Geodesic Kernels
+   Distance, bearing and a local east / north projection on a spherical earth
+   (same radius as TinyGPSPlus, so distances match what the firmware used before).
+
+   - geo_* are scalar functions for the firmware, they use the math library.
+   - geo_*_batch process arrays (structure of arrays) for host tools that replay millions of points.
+     Their loops have no branches and use polynomial sin / asin / atan instead of library calls,
+     so the compiler can vectorise them (e.g. -O3 -march=native).
+     They agree with the scalar functions far below the GPS accuracy, host_tools/geo_bench checks this.
+
+   Header only, doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __GEODESIC
+#define __GEODESIC
+
+#include <math.h>
+#include <stddef.h>
+
+#define GEO_EARTH_RADIUS 6372795.0 // m
+#define GEO_PI 3.14159265358979323846
+#define GEO_DEG_TO_RAD (GEO_PI / 180.0)
+#define GEO_RAD_TO_DEG (180.0 / GEO_PI)
+
+// Local tangent plane around a reference point (equirectangular, good for a few km)
+struct geo_enu_struct
+{
+	double lat0; // Reference (degrees)
+	double lng0;
+	double m_per_deg_lat;
+	double m_per_deg_lng; // Shrinks with cos(lat0)
+};
+
+/////////////////////////////////////////////////////////////////////////
+// Scalar
+
+// Great circle distance (m)
+static inline double geo_haversine_m(double lat1, double lng1, double lat2, double lng2)
+{
+	double dlat = (lat2 - lat1) * GEO_DEG_TO_RAD;
+	double dlng = (lng2 - lng1) * GEO_DEG_TO_RAD;
+	double s_lat = sin(dlat / 2);
+	double s_lng = sin(dlng / 2);
+	double a = s_lat * s_lat + cos(lat1 * GEO_DEG_TO_RAD) * cos(lat2 * GEO_DEG_TO_RAD) * s_lng * s_lng;
+	if (a > 1)
+		a = 1;
+	return 2 * GEO_EARTH_RADIUS * asin(sqrt(a));
+}
+
+// Fast approximation for short distances (m), the error stays below 0.1% up to a few km
+static inline double geo_equirectangular_m(double lat1, double lng1, double lat2, double lng2)
+{
+	double x = (lng2 - lng1) * GEO_DEG_TO_RAD * cos((lat1 + lat2) / 2 * GEO_DEG_TO_RAD);
+	double y = (lat2 - lat1) * GEO_DEG_TO_RAD;
+	return GEO_EARTH_RADIUS * sqrt(x * x + y * y);
+}
+
+// Initial bearing from point 1 to point 2 (degrees, 0 = north, clockwise), like TinyGPSPlus::courseTo()
+static inline double geo_bearing_deg(double lat1, double lng1, double lat2, double lng2)
+{
+	double phi1 = lat1 * GEO_DEG_TO_RAD;
+	double phi2 = lat2 * GEO_DEG_TO_RAD;
+	double dlng = (lng2 - lng1) * GEO_DEG_TO_RAD;
+	double y = sin(dlng) * cos(phi2);
+	double x = cos(phi1) * sin(phi2) - sin(phi1) * cos(phi2) * cos(dlng);
+	double bearing = atan2(y, x) * GEO_RAD_TO_DEG;
+	return bearing < 0 ? bearing + 360 : bearing;
+}
+
+static inline void geo_enu_init(geo_enu_struct *enu, double lat0, double lng0)
+{
+	enu->lat0 = lat0;
+	enu->lng0 = lng0;
+	enu->m_per_deg_lat = GEO_EARTH_RADIUS * GEO_DEG_TO_RAD;
+	enu->m_per_deg_lng = enu->m_per_deg_lat * cos(lat0 * GEO_DEG_TO_RAD);
+}
+
+// Position relative to the reference point (m)
+static inline void geo_enu_project(const geo_enu_struct *enu, double lat, double lng, double *east, double *north)
+{
+	*east = (lng - enu->lng0) * enu->m_per_deg_lng;
+	*north = (lat - enu->lat0) * enu->m_per_deg_lat;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Polynomial approximations for the batched functions (branch free)
+
+// sin(x) for |x| <= pi/2, Taylor series up to x^17 (error < 1e-13)
+static inline double geo_poly_sin(double x)
+{
+	double x2 = x * x;
+	double p = 1.0 / 355687428096000.0;
+	p = p * x2 - 1.0 / 1307674368000.0;
+	p = p * x2 + 1.0 / 6227020800.0;
+	p = p * x2 - 1.0 / 39916800.0;
+	p = p * x2 + 1.0 / 362880.0;
+	p = p * x2 - 1.0 / 5040.0;
+	p = p * x2 + 1.0 / 120.0;
+	p = p * x2 - 1.0 / 6.0;
+	return x + x * x2 * p;
+}
+
+// sin(x) for |x| <= pi
+static inline double geo_poly_sin_pi(double x)
+{
+	double reduced = x > GEO_PI / 2 ? GEO_PI - x : x;
+	reduced = x < -GEO_PI / 2 ? -GEO_PI - x : reduced;
+	return geo_poly_sin(reduced);
+}
+
+// cos(x) for |x| <= pi/2
+static inline double geo_poly_cos(double x)
+{
+	return geo_poly_sin(GEO_PI / 2 - fabs(x));
+}
+
+// asin(x) for 0 <= x <= 0.5, Taylor series (error < 1e-10)
+static inline double geo_poly_asin_half(double x)
+{
+	// (2n)! / (4^n * n!^2 * (2n + 1))
+	static const double c[] = {1.0, 0.16666666666666666, 0.075, 0.044642857142857144, 0.030381944444444444,
+							   0.022372159090909092, 0.017352764423076924, 0.01396484375, 0.011551800896139705,
+							   0.009761609529194078, 0.008390335809616815, 0.0073125258735988454, 0.006447210311889649,
+							   0.005740037670841924};
+	double x2 = x * x;
+	double p = c[13];
+	for (int i = 12; i >= 0; i--)
+		p = p * x2 + c[i];
+	return x * p;
+}
+
+// asin(x) for 0 <= x <= 1
+static inline double geo_poly_asin(double x)
+{
+	double low = geo_poly_asin_half(x);
+	double high = GEO_PI / 2 - 2 * geo_poly_asin_half(sqrt((1 - x) / 2));
+	return x > 0.5 ? high : low;
+}
+
+// atan(t) for |t| <= tan(pi/8), Taylor series (error < 1e-10)
+static inline double geo_poly_atan_small(double t)
+{
+	double t2 = t * t;
+	double p = 1.0 / 25;
+	for (int n = 11; n >= 0; n--)
+		p = p * t2 + ((n & 1) ? -1.0 : 1.0) / (2 * n + 1);
+	return t * p;
+}
+
+// atan2(y, x)
+static inline double geo_poly_atan2(double y, double x)
+{
+	double ax = fabs(x), ay = fabs(y);
+	double mx = ax > ay ? ax : ay;
+	double mn = ax > ay ? ay : ax;
+	double a = mx > 0 ? mn / mx : 0; // 0..1
+
+	// atan(a) = pi/4 + atan((a - 1) / (a + 1)) for a > tan(pi/8)
+	double big = a > 0.41421356237309503;
+	double t = big ? (a - 1) / (a + 1) : a;
+	double r = geo_poly_atan_small(t) + big * (GEO_PI / 4);
+
+	r = ay > ax ? GEO_PI / 2 - r : r;
+	r = x < 0 ? GEO_PI - r : r;
+	return y < 0 ? -r : r;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Batched (structure of arrays)
+
+// Distance (m) of n point pairs
+static inline void geo_haversine_batch(const double *__restrict lat1, const double *__restrict lng1, const double *__restrict lat2,
+									   const double *__restrict lng2, double *__restrict out, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		double dlng = (lng2[i] - lng1[i]) * GEO_DEG_TO_RAD;
+		dlng = dlng > GEO_PI ? dlng - 2 * GEO_PI : dlng; // Shortest way around (|dlng / 2| <= pi/2)
+		dlng = dlng < -GEO_PI ? dlng + 2 * GEO_PI : dlng;
+		double s_lat = geo_poly_sin((lat2[i] - lat1[i]) * (GEO_DEG_TO_RAD / 2));
+		double s_lng = geo_poly_sin(dlng / 2);
+		double a = s_lat * s_lat + geo_poly_cos(lat1[i] * GEO_DEG_TO_RAD) * geo_poly_cos(lat2[i] * GEO_DEG_TO_RAD) * s_lng * s_lng;
+		a = a > 1 ? 1 : a;
+		out[i] = 2 * GEO_EARTH_RADIUS * geo_poly_asin(sqrt(a));
+	}
+}
+
+// Distance (m) between consecutive points of a track, out[i] = distance from point i to i + 1 (n - 1 values)
+static inline void geo_track_haversine_batch(const double *__restrict lat, const double *__restrict lng, double *__restrict out, size_t n)
+{
+	if (n > 1)
+		geo_haversine_batch(lat, lng, lat + 1, lng + 1, out, n - 1);
+}
+
+static inline void geo_equirectangular_batch(const double *__restrict lat1, const double *__restrict lng1, const double *__restrict lat2,
+											 const double *__restrict lng2, double *__restrict out, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		double x = (lng2[i] - lng1[i]) * GEO_DEG_TO_RAD * geo_poly_cos((lat1[i] + lat2[i]) * (GEO_DEG_TO_RAD / 2));
+		double y = (lat2[i] - lat1[i]) * GEO_DEG_TO_RAD;
+		out[i] = GEO_EARTH_RADIUS * sqrt(x * x + y * y);
+	}
+}
+
+// Bearing (degrees) of n point pairs
+static inline void geo_bearing_batch(const double *__restrict lat1, const double *__restrict lng1, const double *__restrict lat2,
+									 const double *__restrict lng2, double *__restrict out, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		double phi1 = lat1[i] * GEO_DEG_TO_RAD;
+		double phi2 = lat2[i] * GEO_DEG_TO_RAD;
+		double dlng = (lng2[i] - lng1[i]) * GEO_DEG_TO_RAD;
+		dlng = dlng > GEO_PI ? dlng - 2 * GEO_PI : dlng;
+		dlng = dlng < -GEO_PI ? dlng + 2 * GEO_PI : dlng;
+		// cos(phi1) sin(phi2) - sin(phi1) cos(phi2) cos(dlng) without the cancellation for close points
+		double s_lng = geo_poly_sin(dlng / 2);
+		double y = geo_poly_sin_pi(dlng) * geo_poly_cos(phi2);
+		double x = geo_poly_sin_pi(phi2 - phi1) + 2 * geo_poly_sin(phi1) * geo_poly_cos(phi2) * s_lng * s_lng;
+		double bearing = geo_poly_atan2(y, x) * GEO_RAD_TO_DEG;
+		out[i] = bearing < 0 ? bearing + 360 : bearing;
+	}
+}
+
+static inline void geo_enu_project_batch(const geo_enu_struct *enu, const double *__restrict lat, const double *__restrict lng,
+										 double *__restrict east, double *__restrict north, size_t n)
+{
+	double lat0 = enu->lat0, lng0 = enu->lng0;
+	double m_lat = enu->m_per_deg_lat, m_lng = enu->m_per_deg_lng;
+	for (size_t i = 0; i < n; i++)
+	{
+		east[i] = (lng[i] - lng0) * m_lng;
+		north[i] = (lat[i] - lat0) * m_lat;
+	}
+}
+
+#endif
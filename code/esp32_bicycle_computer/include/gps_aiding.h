@@ -0,0 +1,52 @@
+/*
+   GPS Aiding
+   The last good fix (position, time and quality) is saved, at boot it is sent to the receiver together with the
+   time of the DS3231 (UBX-MGA-INI-POS_LLH and UBX-MGA-INI-TIME_UTC, see ubx.h). Knowing roughly where and when
+   it is, the receiver only searches for the satellites that are visible, which shortens the time to first fix.
+
+   The accuracies sent along are estimates: the position gets the error of the saved fix (HDOP * GPS_AIDING_UERE)
+   plus pos_margin (the bike may have been moved), the time one second (the DS3231 is set in whole seconds)
+   plus the drift of the DS3231 since the saved fix. The time is only sent if the clock is after the saved fix.
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __GPS_AIDING
+#define __GPS_AIDING
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ubx.h"
+
+#define GPS_AIDING_MAGIC 0x44494147 // "GAID"
+#define GPS_AIDING_UERE 5.0			// Range error (m) of one satellite, times HDOP gives the error of a fix
+#define GPS_AIDING_RTC_PPM 2.0		// Max. drift of the DS3231 (0..40°C)
+#define GPS_AIDING_MAX_FRAMES_SIZE (2 * UBX_OVERHEAD + sizeof(ubx_mga_ini_pos_llh_struct) + sizeof(ubx_mga_ini_time_utc_struct))
+
+struct gps_aiding_struct
+{
+	uint32_t magic;
+	int32_t lat; // 1e-7 deg
+	int32_t lng;
+	int32_t altitude;	// cm
+	uint32_t time;		// UTC, seconds since 01.01.2000
+	uint16_t hdop;		// 1/100
+	uint8_t satellites;
+	uint32_t crc; // CRC32 of everything above
+};
+
+// Saves a fix
+void gps_aiding_set(gps_aiding_struct *a, double lat, double lng, double altitude, uint32_t time, double hdop, uint8_t satellites);
+
+// Checks the saved fix (RTC memory is random after a power cycle)
+bool gps_aiding_valid(const gps_aiding_struct *a);
+
+// Builds the aiding frames in out (GPS_AIDING_MAX_FRAMES_SIZE bytes), returns their total length
+// now: UTC (seconds since 01.01.2000) and ms since the start of that second
+size_t gps_aiding_frames(const gps_aiding_struct *a, uint32_t now, uint16_t now_ms, double pos_margin, uint8_t *out, size_t size);
+
+// Converts seconds since 01.01.2000 into the date and time
+void gps_aiding_date(uint32_t time, uint16_t *year, uint8_t *month, uint8_t *day, uint8_t *hour, uint8_t *minute, uint8_t *second);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+   Log Chunks
+   The CSV log is split into chunks of LOG_CHUNK_SIZE bytes.
+   Chunk 0 only holds the CSV header line, padded with spaces and a '\n', so the column names stay on the
+   first line of the file. Every following chunk starts at a multiple of LOG_CHUNK_SIZE with a fixed-size
+   summary line:
+
+   #CHUNK,<index>,<first time>,<last time>,<lat min>,<lat max>,<lng min>,<lng max>,<first distance>,<last distance>,<rows>,<length>,<crc32>
+
+   - times are seconds since 01.01.2000 (like RtcDateTime::TotalSeconds())
+   - distances are the total travelled distance in km
+   - <length> is the number of bytes after the summary line that are covered by the CRC32
+
+   The line is padded with spaces to LOG_CHUNK_HEADER_SIZE bytes (including the '\n').
+   Rows never cross a chunk boundary, the rest of a full chunk is filled with spaces and a '\n'.
+   A reader can therefore jump to any time or area of a ride by reading only the summary lines.
+   Spreadsheet programs just see a few comment lines.
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __LOG_CHUNK
+#define __LOG_CHUNK
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_CHUNK_SIZE 4096		   // Multiple of the SD sector size (512)
+#define LOG_CHUNK_HEADER_SIZE 160 // Size of the summary line
+#define LOG_CHUNK_DATA_SIZE (LOG_CHUNK_SIZE - LOG_CHUNK_HEADER_SIZE)
+
+struct log_chunk_struct
+{
+	uint32_t index; // Number of the chunk inside the file (1 for the first one with data)
+	uint32_t first_time;
+	uint32_t last_time;
+	double lat_min, lat_max;
+	double lng_min, lng_max;
+	double first_distance;
+	double last_distance;
+	uint32_t rows;	 // Number of fixes
+	uint32_t length; // Bytes after the summary line
+	uint32_t crc;	 // CRC32 of these bytes
+};
+
+// CRC32 (IEEE 802.3), start with crc = 0
+uint32_t log_crc32(uint32_t crc, const void *data, size_t length);
+
+// Resets the summary for a new chunk
+void log_chunk_begin(log_chunk_struct *c, uint32_t index);
+
+// Adds a fix to the bounding box and time / distance range
+void log_chunk_add_fix(log_chunk_struct *c, uint32_t time, double lat, double lng, double distance_km);
+
+// Adds bytes that were written after the summary line (rows or padding)
+void log_chunk_add_data(log_chunk_struct *c, const void *data, size_t length);
+
+// Free bytes in the current chunk
+size_t log_chunk_free(const log_chunk_struct *c);
+
+// Writes the summary line (exactly LOG_CHUNK_HEADER_SIZE bytes, not zero terminated)
+void log_chunk_format_header(const log_chunk_struct *c, char *buffer);
+
+// Reads a summary line, returns false if the buffer doesn't contain one
+bool log_chunk_parse_header(const char *buffer, log_chunk_struct *c);
+
+#endif
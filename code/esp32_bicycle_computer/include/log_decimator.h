@@ -0,0 +1,54 @@
+/*
+   Log Decimator
+   Decides which fixes are written to the log. Logging at a fixed rate writes the same straight line over
+   and over on a long road, but only a few points in a switchback. A fix is kept if one of these is true
+   since the last kept fix:
+   - the distance to it exceeds distance (m),
+   - the heading changed by more than heading (degrees),
+   - max_interval (ms) passed, so the log never has a gap longer than that (plus the rate of the fixes).
+   All other fixes are dropped and counted.
+
+   The heading is the bearing between two fixes that are at least heading_distance (m) apart, so the
+   position jitter at a low speed doesn't turn into heading changes.
+
+   host_tools/log_decimate replays a full-rate log and prints the reconstruction error.
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __LOG_DECIMATOR
+#define __LOG_DECIMATOR
+
+#include <stdint.h>
+
+struct log_decimator_struct
+{
+	// Parameters (set by log_decimator_init())
+	double distance;		 // m
+	double heading;			 // Degrees
+	double heading_distance; // m
+	uint32_t max_interval;	 // ms
+
+	// State
+	bool started; // False / 0 until the first fix was kept
+	double last_lat; // Last kept fix
+	double last_lng;
+	uint32_t last_time;
+	double last_heading; // Heading at the last kept fix
+	bool heading_valid;
+	double heading_lat; // Start of the segment the current heading is measured over
+	double heading_lng;
+	double current_heading;
+
+	// Statistics
+	uint32_t kept;
+	uint32_t dropped;
+};
+
+// Reset and set the parameters
+void log_decimator_init(log_decimator_struct *d, double distance, double heading, double heading_distance, uint32_t max_interval);
+
+// Process a fix (time in ms), returns true if it is to be logged
+bool log_decimator_keep(log_decimator_struct *d, uint32_t time, double lat, double lng);
+
+#endif
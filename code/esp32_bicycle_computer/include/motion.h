@@ -0,0 +1,80 @@
+/*
+   Motion
+   Classifies the state of the bike from the GPS fixes: moving, slow, stopped or parked.
+   A speed threshold alone isn't enough: standing at a traffic light the GPS speed jumps around by a few
+   km/h and the position wanders by several meters, which adds distance, path segments and log rows.
+
+   - Speed with hysteresis: moving above speed_move (back to slow below speed_move - speed_hyst),
+     slow above speed_stop + speed_hyst, stopped after stop_time ms below speed_stop.
+   - Position spread: the bike only starts moving (stopped -> slow / moving) once a fix is more than
+     radius meters away from the anchor (the position where it stopped). While moving the anchor
+     follows in radius steps, if it doesn't move for still_time ms the speed is considered noise.
+   - HDOP with hysteresis: fixes worse than hdop_bad don't change the state until one is better than
+     hdop_good again, only the timeouts apply.
+   - Parked after park_time ms in the stopped state, motion_hold() (a button press) restarts this time.
+
+   motion_update() is called for every fix, motion_tick() regularly (also without fixes) for the timeouts.
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __MOTION
+#define __MOTION
+
+#include <stdint.h>
+
+enum motion_state_enum
+{
+	MOTION_MOVING,
+	MOTION_SLOW, // Moving slowly (pushing the bike, rolling up to a traffic light)
+	MOTION_STOPPED,
+	MOTION_PARKED
+};
+
+struct motion_struct
+{
+	// Parameters (set by motion_init())
+	double speed_stop; // km/h
+	double speed_move;
+	double speed_hyst;
+	double hdop_good;
+	double hdop_bad;
+	double radius; // m
+	uint32_t stop_time; // ms
+	uint32_t still_time;
+	uint32_t park_time;
+
+	// State
+	uint8_t state; // motion_state_enum
+	uint32_t state_since; // Time of the last state change (ms)
+	bool good;			  // HDOP is good enough to change the state
+	bool anchor_set;
+	double anchor_lat;
+	double anchor_lng;
+	uint32_t displaced_time; // Time the position last left the radius around the anchor
+	bool below_stop;		 // Speed is below speed_stop
+	uint32_t below_stop_since;
+	double spread;			 // Distance of the last fix from the anchor (m)
+	uint32_t changes;		 // Number of state changes
+};
+
+// Reset and set the parameters, the bike starts stopped
+void motion_init(motion_struct *m, double speed_stop, double speed_move, double speed_hyst, double hdop_good, double hdop_bad, double radius,
+				 uint32_t stop_time, uint32_t still_time, uint32_t park_time, uint32_t time);
+
+// Process a fix (speed in km/h), returns the new state
+uint8_t motion_update(motion_struct *m, uint32_t time, double lat, double lng, double speed, double hdop);
+
+// Timeouts without a fix, returns the new state
+uint8_t motion_tick(motion_struct *m, uint32_t time);
+
+// Someone is using the bike (button press): a stopped or parked bike is stopped again and parked park_time ms later
+void motion_hold(motion_struct *m, uint32_t time);
+
+// True while moving or slow: distance, path and log are updated
+static inline bool motion_moving(const motion_struct *m)
+{
+	return m->state <= MOTION_SLOW;
+}
+
+#endif
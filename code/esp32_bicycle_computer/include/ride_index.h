@@ -0,0 +1,38 @@
+/*
+   Ride Index
+   Layout of the "rides.idx" file on the SD card.
+
+   The file is append-only and contains one fixed-size entry per ride (one ride = one boot / one CSV file).
+   While a ride is running, only its own (last) entry gets rewritten, so all previous entries never change.
+   This way the history of all rides can be listed by reading RIDE_INDEX_ENTRY_SIZE bytes per ride,
+   without parsing any of the CSV files.
+
+   All values are stored little-endian (native on the ESP32 and on x86 / ARM PCs).
+   Times are seconds since 01.01.2000 00:00:00 (RtcDateTime::TotalSeconds()), in local time like the RTC.
+ */
+
+#ifndef __RIDE_INDEX
+#define __RIDE_INDEX
+
+#include <stdint.h>
+
+#define RIDE_INDEX_FILENAME "rides.idx"
+#define RIDE_INDEX_MAGIC 0x31444952 // "RID1"
+#define RIDE_INDEX_ENTRY_SIZE 64
+#define RIDE_INDEX_NAME_LENGTH 36
+
+struct ride_index_entry_struct
+{
+	char file_name[RIDE_INDEX_NAME_LENGTH]; // Name of the CSV file, zero terminated
+	uint32_t start_time;					// Seconds since 2000
+	uint32_t end_time;						// Seconds since 2000, time of the last update
+	float distance_km;
+	float max_speed;		  // km/h
+	uint32_t moving_time;	  // Seconds while moving or slow (see motion_moving() in motion.h)
+	uint32_t checkpoint_pos;  // Size of the CSV file at the last update (byte offset)
+	uint32_t magic;			  // RIDE_INDEX_MAGIC, marks a completely written entry
+};
+
+static_assert(sizeof(ride_index_entry_struct) == RIDE_INDEX_ENTRY_SIZE, "ride index entries must have a fixed size");
+
+#endif
@@ -0,0 +1,65 @@
+/*
+   RTC Track
+   The last fixes, compressed with the track codec (see track_codec.h), in a ring of blocks that is kept
+   in RTC slow memory. It survives software resets, watchdog resets and deep sleep (not a power cycle).
+
+   Every logged fix gets a sequence number and is added here before it is queued for the SD card.
+   Once its row is on the card, the bus task marks it as persisted. After a reset the fixes that
+   were never persisted (queued, in the RAM backlog while the card was missing, or in flight)
+   are recovered and written to the log of the resumed ride.
+
+   Memory budget (ESP32 RTC slow memory: 8 KB, the checkpoint uses ~0.3 KB):
+   - RTC_TRACK_BLOCKS * TRACK_BLOCK_SIZE = 3 KB of finished blocks
+   - ~1 KB encoder with the current block and the LZ window
+   - 4 KB in total (sizeof(rtc_track_struct)), the last ~200..300 fixes
+     (~2 minutes at the 500ms log interval, more while standing, see host_tools/track_pack)
+   Older fixes are overwritten, also if they weren't persisted yet (they are counted as lost).
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __RTC_TRACK
+#define __RTC_TRACK
+
+#include <stdint.h>
+
+#include "track_codec.h"
+
+#define RTC_TRACK_BLOCKS 6
+#define RTC_TRACK_MAGIC 0x4B525452 // "RTRK"
+
+struct rtc_track_struct
+{
+	// Covered by crc, only changed by rtc_track_add()
+	uint32_t magic;
+	uint32_t next_seq;					  // Sequence number of the next fix
+	uint32_t finished;					  // Number of finished blocks, the oldest is in slot finished % RTC_TRACK_BLOCKS
+	uint32_t first_seq[RTC_TRACK_BLOCKS]; // Sequence number of the first fix of each slot
+	uint32_t current_seq;				  // Sequence number of the first fix of the current block
+	uint32_t crc;
+
+	volatile uint32_t persisted_seq; // Fixes before this one are on the SD card (written by another task)
+	track_encoder_struct encoder;	 // Current block
+	uint8_t blocks[RTC_TRACK_BLOCKS][TRACK_BLOCK_SIZE];
+};
+
+// Called for every recovered fix (oldest first)
+typedef void (*rtc_track_callback)(const track_fix_struct *fix, uint32_t seq, void *context);
+
+// Starts an empty ring
+void rtc_track_init(rtc_track_struct *t, bool lz);
+
+// Checks the ring after a reset (the memory is random after a power cycle)
+bool rtc_track_valid(const rtc_track_struct *t);
+
+// Adds a fix, returns its sequence number
+uint32_t rtc_track_add(rtc_track_struct *t, const track_fix_struct *fix);
+
+// The fix with this sequence number (and all before) is on the SD card
+void rtc_track_persisted(rtc_track_struct *t, uint32_t seq);
+
+// Calls function for every fix that wasn't persisted and is still in the ring
+// Returns the number of these fixes, lost counts the ones that were already overwritten
+int rtc_track_recover(const rtc_track_struct *t, rtc_track_callback function, void *context, uint32_t *lost);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+   Telemetry
+   Binary records of the telemetry stream (ENABLE_TELEMETRY), sent over the USB serial port.
+
+   Frame: 0x00, COBS(type, payload, CRC32 of type and payload), 0x00
+   - COBS (consistent overhead byte stuffing) removes all zero bytes, so 0x00 only appears as delimiter.
+     A receiver can start listening at any time and synchronizes at the next delimiter.
+   - The leading delimiter ends any text that was printed in between, frames with a wrong CRC are dropped.
+   - Records are packed and little endian (ESP32, x86 and ARM hosts).
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __TELEMETRY
+#define __TELEMETRY
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAX_PAYLOAD 64
+// Delimiters + COBS overhead + type + payload + CRC
+#define TELEMETRY_MAX_FRAME (2 + 1 + (TELEMETRY_MAX_PAYLOAD + 5) / 254 + 1 + TELEMETRY_MAX_PAYLOAD + 4)
+
+enum telemetry_type_enum
+{
+	TELEMETRY_FIX = 1,
+	TELEMETRY_SENSOR = 2,
+	TELEMETRY_PROFILE = 3,
+	TELEMETRY_LOG = 4
+};
+
+#pragma pack(push, 1)
+// Every GPS fix
+struct telemetry_fix_struct
+{
+	uint32_t time_ms; // Since boot
+	double lat;
+	double lng;
+	float speed; // km/h
+	float altitude;
+	float course;
+	float distance_km;
+	float grade;
+	uint8_t satellites;
+};
+
+// Sensor readings (every 500ms)
+struct telemetry_sensor_struct
+{
+	uint32_t time_ms;
+	float temperature;
+	float humidity;
+	uint16_t light;		// Filtered LDR reading
+	uint16_t backlight; // PWM value
+	float battery_voltage;
+	float battery_soc;
+	float battery_runtime_h;
+};
+
+// Profiler counters (every second)
+struct telemetry_profile_struct
+{
+	uint32_t time_ms;
+	uint32_t loops;		 // Loop iterations since the last record
+	uint32_t ui_compose_us; // Averages since the last record
+	uint32_t ui_queue_us;
+	uint32_t lcd_send_us;
+	uint32_t free_heap;
+	uint16_t backlog_rows;
+	uint8_t sd_state;
+	uint8_t screen;
+	uint32_t log_dropped;
+	uint32_t telemetry_dropped;
+	uint32_t gps_chars;
+	uint32_t gps_failed_checksum;
+};
+
+// Event of the deferred debug log (see debug_log.h)
+struct telemetry_log_struct
+{
+	uint32_t time_ms;
+	uint16_t id;
+	uint8_t level;
+	int32_t args[4];
+};
+#pragma pack(pop)
+
+// out has to hold length + length / 254 + 1 bytes, returns the encoded length
+size_t cobs_encode(const uint8_t *data, size_t length, uint8_t *out);
+
+// Returns the decoded length, 0 if the data is not valid COBS or doesn't fit into out
+size_t cobs_decode(const uint8_t *data, size_t length, uint8_t *out, size_t out_size);
+
+// Builds a complete frame (including both delimiters) in out (TELEMETRY_MAX_FRAME bytes), returns its length
+size_t telemetry_frame(uint8_t type, const void *payload, size_t length, uint8_t *out);
+
+// Decodes the bytes between two delimiters, returns the payload length or -1 if the frame is invalid
+int telemetry_parse(const uint8_t *frame, size_t length, uint8_t *type, uint8_t *payload);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+   Track Codec
+   Compact binary copy of the CSV log (ENABLE_TRACK_COMPRESSION), written to a *.trk file next to it.
+
+   - Every fix is quantized to the precision of the CSV row (track_fix_struct), so a decoded row
+     reads like the original one.
+   - Each field is predicted from the previous fixes of the block: time, position and distance
+     linearly (previous value + previous step), the rest by the previous value.
+     The difference is written as zig-zag varint, which is one byte for most fields.
+   - Optionally a small LZ stage replaces byte sequences that already appeared in the last
+     TRACK_LZ_WINDOW bytes of the block (repeating steps, unchanged sensors).
+   - The file consists of blocks of TRACK_BLOCK_SIZE bytes. Each block starts with a header and
+     the first fix in full (restart point), so blocks can be decoded independently and a damaged
+     block only loses its own fixes. The encoder needs one block of RAM.
+
+   Block header (little endian):
+   "TK", version, flags, <fixes (16 bit)>, <payload bytes (16 bit)>, <first time (32 bit)>, <CRC32 of the payload>
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __TRACK_CODEC
+#define __TRACK_CODEC
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACK_BLOCK_SIZE 512 // One SD sector
+#define TRACK_BLOCK_HEADER_SIZE 16
+#define TRACK_BLOCK_PAYLOAD (TRACK_BLOCK_SIZE - TRACK_BLOCK_HEADER_SIZE)
+#define TRACK_BLOCK_MAX_FIXES (TRACK_BLOCK_PAYLOAD / 2) // A fix takes at least 2 bytes (LZ match)
+#define TRACK_LZ_WINDOW 256
+#define TRACK_VERSION 1
+#define TRACK_FLAG_LZ 0x01
+#define TRACK_NAN INT32_MIN // Value of a field that was "nan" or empty in the CSV row
+
+// Columns of the CSV row
+enum track_field_enum
+{
+	TRACK_TIME, // Seconds since 2000 (local time, like the chunk summaries)
+	TRACK_LAT,
+	TRACK_LNG,
+	TRACK_SPEED,
+	TRACK_SATELLITES,
+	TRACK_TEMPERATURE,
+	TRACK_HUMIDITY,
+	TRACK_LIGHT,
+	TRACK_DISTANCE,
+	TRACK_ALTITUDE,
+	TRACK_ASCENT,
+	TRACK_DESCENT,
+	TRACK_GRADE,
+	TRACK_BATTERY,
+	TRACK_FIELDS
+};
+
+// One fix, every field as integer in units of its CSV precision (see track_field_scale)
+struct track_fix_struct
+{
+	int32_t value[TRACK_FIELDS];
+};
+
+extern const double track_field_scale[TRACK_FIELDS];
+
+struct track_encoder_struct
+{
+	uint8_t block[TRACK_BLOCK_SIZE];
+	uint16_t length; // Payload bytes
+	uint16_t fixes;
+	uint8_t flags;
+	int32_t last[TRACK_FIELDS];
+	int64_t last_step[TRACK_FIELDS];
+	uint8_t window[TRACK_LZ_WINDOW]; // Last bytes before the LZ stage (ring)
+	uint32_t window_length;			 // Bytes in the block so far
+};
+
+// Sets a field from the value printed in the CSV row (rounded to the CSV precision)
+void track_fix_set(track_fix_struct *fix, track_field_enum field, double value);
+
+// Value of a field (NAN for TRACK_NAN)
+double track_fix_get(const track_fix_struct *fix, track_field_enum field);
+
+// Starts with an empty block
+void track_encoder_init(track_encoder_struct *e, bool lz);
+
+// Adds a fix to the current block
+// Returns false if the block is full, it has to be written and track_encoder_next_block() called
+bool track_encoder_add(track_encoder_struct *e, const track_fix_struct *fix);
+
+// Fills in the header and returns the current block (TRACK_BLOCK_SIZE bytes)
+// Can be called at any time, e.g. to write a partial block before the ride ends
+const uint8_t *track_encoder_block(track_encoder_struct *e);
+
+// Starts a new block (restart point)
+void track_encoder_next_block(track_encoder_struct *e);
+
+// Decodes a block, returns the number of fixes or -1 if the block is empty or damaged
+int track_decode_block(const uint8_t *block, track_fix_struct *fixes, int max_fixes);
+
+// Like track_decode_block(), but calls function for every fix instead of storing them (no large buffer)
+typedef void (*track_fix_callback)(const track_fix_struct *fix, int index, void *context);
+int track_decode_block_each(const uint8_t *block, track_fix_callback function, void *context);
+
+// Formats a fix like the CSV row of the logger (including "\n"), returns the length
+// Temperature and humidity are empty if they are TRACK_NAN
+// utc_offset_s is subtracted from the time of day (the CSV contains the GPS time)
+int track_format_row(const track_fix_struct *fix, long utc_offset_s, char *row, size_t size);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+   UBX
+   Frames of the u-blox binary protocol, used to control and aid the GPS receiver.
+
+   Frame: 0xB5, 0x62, class, id, payload length (2 bytes), payload, checksum (2 bytes)
+   - The checksum is an 8 bit Fletcher checksum over class, id, length and payload.
+   - The receiver sends UBX frames and NMEA sentences over the same line, the parser skips everything
+     that isn't a frame.
+   - Payloads are packed and little endian (ESP32, x86 and ARM hosts).
+
+   This file doesn't depend on Arduino, so it can be used by the host tools too.
+ */
+
+#ifndef __UBX
+#define __UBX
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+#define UBX_OVERHEAD 8 // Sync, class, id, length, checksum
+#define UBX_MAX_PAYLOAD 100
+
+// Classes and ids
+#define UBX_CLASS_ACK 0x05
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_CLASS_RXM 0x02
+#define UBX_RXM_PMREQ 0x41 // Power management request
+#define UBX_CLASS_MGA 0x13
+#define UBX_MGA_INI 0x40 // Initial position / time (u-blox M8 and newer)
+#define UBX_MGA_ACK 0x60
+
+// Types of the UBX-MGA-INI messages
+#define UBX_MGA_INI_POS_LLH 0x01
+#define UBX_MGA_INI_TIME_UTC 0x10
+
+#pragma pack(push, 1)
+// UBX-RXM-PMREQ
+struct ubx_rxm_pmreq_struct
+{
+	uint32_t duration; // ms, 0: until woken up (activity on RX or EXTINT)
+	uint32_t flags;	   // Bit 1: backup
+};
+#define UBX_PMREQ_BACKUP 0x02
+
+// UBX-MGA-INI-POS_LLH
+struct ubx_mga_ini_pos_llh_struct
+{
+	uint8_t type; // UBX_MGA_INI_POS_LLH
+	uint8_t version;
+	uint8_t reserved[2];
+	int32_t lat; // 1e-7 deg
+	int32_t lon;
+	int32_t alt;	 // cm above the ellipsoid
+	uint32_t pos_acc; // cm
+};
+
+// UBX-MGA-INI-TIME_UTC
+struct ubx_mga_ini_time_utc_struct
+{
+	uint8_t type; // UBX_MGA_INI_TIME_UTC
+	uint8_t version;
+	uint8_t ref;	   // 0: the time is valid when the message is received
+	int8_t leap_secs; // -128: unknown
+	uint16_t year;
+	uint8_t month;
+	uint8_t day;
+	uint8_t hour;
+	uint8_t minute;
+	uint8_t second;
+	uint8_t reserved1;
+	uint32_t ns;
+	uint16_t t_acc_s;
+	uint8_t reserved2[2];
+	uint32_t t_acc_ns;
+};
+#pragma pack(pop)
+
+// Builds a complete frame in out (UBX_OVERHEAD + length bytes), returns its length (0 if it doesn't fit)
+size_t ubx_frame(uint8_t message_class, uint8_t id, const void *payload, uint16_t length, uint8_t *out, size_t size);
+
+struct ubx_parser_struct
+{
+	uint8_t state;
+	uint8_t message_class;
+	uint8_t id;
+	uint16_t length;
+	uint16_t index;
+	uint8_t checksum[2];
+	uint8_t payload[UBX_MAX_PAYLOAD];
+	uint32_t frames;	   // Valid frames
+	uint32_t failed_checksum; // Frames with a wrong checksum or a payload longer than UBX_MAX_PAYLOAD
+};
+
+void ubx_parser_init(ubx_parser_struct *p);
+
+// Feeds one byte, returns true once a valid frame is complete (message_class, id, length and payload)
+bool ubx_parse(ubx_parser_struct *p, uint8_t byte);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+   Battery Monitor
+   See battery_monitor.h
+ */
+
+#include "battery_monitor.h"
+
+// Discharge curve of a single Li-Ion cell at a low load
+static const double discharge_voltage[] = {3.20, 3.40, 3.55, 3.65, 3.70, 3.75, 3.80, 3.85, 3.92, 4.00, 4.10, 4.20};
+static const double discharge_soc[] = {0, 5, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100};
+#define DISCHARGE_POINTS (sizeof(discharge_voltage) / sizeof(double))
+
+// Weight of a new rate window, the curve gets steep near empty so recent windows count more there
+#define RATE_WEIGHT 0.5
+#define RATE_WEIGHT_LOW 0.8
+#define LOW_SOC 20 // %
+
+double battery_voltage_from_reference(double ref_reading, double ref_voltage)
+{
+	if (ref_reading <= 0)
+	{
+		return 0;
+	}
+	return (4095.0 / ref_reading) * ref_voltage;
+}
+
+double battery_soc(double voltage)
+{
+	if (voltage <= discharge_voltage[0])
+	{
+		return 0;
+	}
+	for (unsigned int i = 1; i < DISCHARGE_POINTS; i++)
+	{
+		if (voltage < discharge_voltage[i])
+		{ // Linear interpolation between the two points
+			double f = (voltage - discharge_voltage[i - 1]) / (discharge_voltage[i] - discharge_voltage[i - 1]);
+			return discharge_soc[i - 1] + f * (discharge_soc[i] - discharge_soc[i - 1]);
+		}
+	}
+	return 100;
+}
+
+void battery_init(battery_struct *b, double filter_factor, double nominal_runtime_h, uint32_t rate_window_ms)
+{
+	b->filter_factor = filter_factor;
+	b->nominal_runtime_h = nominal_runtime_h;
+	b->rate_window_ms = rate_window_ms;
+
+	b->startup = 0;
+	b->voltage = 0;
+	b->soc = 0;
+	b->window_start_ms = 0;
+	b->window_start_soc = 0;
+	b->rate = 0;
+	b->runtime_h = 0;
+}
+
+void battery_update(battery_struct *b, double voltage, uint32_t now_ms)
+{
+	if (!b->startup)
+	{ // Called once for the first sample
+		b->startup = 1;
+		b->voltage = voltage;
+		b->soc = battery_soc(voltage);
+		b->window_start_ms = now_ms;
+		b->window_start_soc = b->soc;
+	}
+	else
+	{
+		b->voltage = b->voltage + b->filter_factor * (voltage - b->voltage);
+		b->soc = battery_soc(b->voltage);
+	}
+
+	// Measure the discharge rate
+	uint32_t elapsed = now_ms - b->window_start_ms;
+	if (elapsed >= b->rate_window_ms)
+	{
+		double rate = (b->window_start_soc - b->soc) / (elapsed / 3600000.0);
+		if (rate >= 0)
+		{ // Ignore windows where the battery was charged, but not the flat part of the curve
+			double weight = b->soc < LOW_SOC ? RATE_WEIGHT_LOW : RATE_WEIGHT;
+			b->rate = (b->rate == 0) ? rate : (b->rate + weight * (rate - b->rate));
+		}
+		b->window_start_ms = now_ms;
+		b->window_start_soc = b->soc;
+	}
+
+	// Remaining runtime
+	// The nominal runtime is the upper limit, a measured rate below it only comes from the flat part of the curve
+	double nominal_rate = 100.0 / b->nominal_runtime_h;
+	b->runtime_h = b->soc / (b->rate > nominal_rate ? b->rate : nominal_rate);
+}
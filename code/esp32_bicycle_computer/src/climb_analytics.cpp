@@ -0,0 +1,73 @@
+/*
+   Climb Analytics
+   See climb_analytics.h
+ */
+
+#include "climb_analytics.h"
+
+void climb_init(climb_struct *c, double deadband_m, double filter_factor, double sample_spacing, double min_window_m)
+{
+	c->deadband_m = deadband_m;
+	c->filter_factor = filter_factor;
+	c->sample_spacing = sample_spacing;
+	c->min_window_m = min_window_m;
+
+	c->startup = 0;
+	c->filtered_alt = 0;
+	c->reference_alt = 0;
+	c->window_head = 0;
+	c->window_count = 0;
+
+	c->total_ascent = 0;
+	c->total_descent = 0;
+	c->grade = 0;
+}
+
+void climb_update(climb_struct *c, double distance_m, double altitude)
+{
+	if (!c->startup)
+	{ // Called once for the first fix
+		c->startup = 1;
+		c->filtered_alt = altitude;
+		c->reference_alt = altitude;
+		c->window[0].distance_m = distance_m;
+		c->window[0].altitude = altitude;
+		c->window_head = 0;
+		c->window_count = 1;
+		return;
+	}
+
+	// Low pass filter
+	c->filtered_alt = c->filtered_alt + c->filter_factor * (altitude - c->filtered_alt);
+
+	// Dead band: only count the change once it is large enough
+	double delta = c->filtered_alt - c->reference_alt;
+	if (delta > c->deadband_m)
+	{
+		c->total_ascent += delta;
+		c->reference_alt = c->filtered_alt;
+	}
+	else if (delta < -c->deadband_m)
+	{
+		c->total_descent -= delta;
+		c->reference_alt = c->filtered_alt;
+	}
+
+	// Add a new sample to the window every sample_spacing meters
+	if (distance_m - c->window[c->window_head].distance_m < c->sample_spacing)
+		return;
+
+	c->window_head = (c->window_head + 1) % CLIMB_WINDOW_SIZE;
+	c->window[c->window_head].distance_m = distance_m;
+	c->window[c->window_head].altitude = c->filtered_alt;
+	if (c->window_count < CLIMB_WINDOW_SIZE)
+		c->window_count++;
+
+	// Grade between the oldest and the newest sample
+	uint8_t tail = (c->window_head + CLIMB_WINDOW_SIZE - (c->window_count - 1)) % CLIMB_WINDOW_SIZE;
+	double run = c->window[c->window_head].distance_m - c->window[tail].distance_m;
+	if (run >= c->min_window_m)
+	{
+		c->grade = (c->window[c->window_head].altitude - c->window[tail].altitude) / run * 100.0;
+	}
+}
@@ -0,0 +1,80 @@
+/*
+   Deferred Debug Log
+   See debug_log.h
+ */
+
+#include "debug_log.h"
+
+void debug_log_init(debug_log_struct *log)
+{
+	for (uint32_t i = 0; i < DEBUG_LOG_SIZE; i++)
+	{
+		log->slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	log->head.store(0, std::memory_order_relaxed);
+	log->tail = 0;
+	log->dropped.store(0, std::memory_order_relaxed);
+}
+
+bool debug_log_push(debug_log_struct *log, uint32_t time_ms, uint8_t level, uint16_t id, int32_t a, int32_t b, int32_t c, int32_t d)
+{
+	uint32_t pos = log->head.load(std::memory_order_relaxed);
+
+	// Claim a slot: it is free if its sequence number equals the position
+	while (true)
+	{
+		uint32_t sequence = log->slots[pos % DEBUG_LOG_SIZE].sequence.load(std::memory_order_acquire);
+		int32_t diff = (int32_t)(sequence - pos);
+		if (diff == 0)
+		{
+			if (log->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{ // Full
+			log->dropped.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+		else
+		{ // Another producer was faster
+			pos = log->head.load(std::memory_order_relaxed);
+		}
+	}
+
+	debug_log_event_struct *event = &log->slots[pos % DEBUG_LOG_SIZE].event;
+	event->time_ms = time_ms;
+	event->id = id;
+	event->level = level;
+	event->args[0] = a;
+	event->args[1] = b;
+	event->args[2] = c;
+	event->args[3] = d;
+
+	// Publish
+	log->slots[pos % DEBUG_LOG_SIZE].sequence.store(pos + 1, std::memory_order_release);
+	return 1;
+}
+
+bool debug_log_pop(debug_log_struct *log, debug_log_event_struct *event)
+{
+	uint32_t pos = log->tail;
+	uint32_t sequence = log->slots[pos % DEBUG_LOG_SIZE].sequence.load(std::memory_order_acquire);
+	if ((int32_t)(sequence - (pos + 1)) < 0)
+	{ // Empty (or the producer hasn't finished writing yet)
+		return 0;
+	}
+
+	*event = log->slots[pos % DEBUG_LOG_SIZE].event;
+	log->tail = pos + 1;
+
+	// Free the slot for the next round
+	log->slots[pos % DEBUG_LOG_SIZE].sequence.store(pos + DEBUG_LOG_SIZE, std::memory_order_release);
+	return 1;
+}
+
+uint32_t debug_log_take_dropped(debug_log_struct *log)
+{
+	return log->dropped.exchange(0, std::memory_order_relaxed);
+}
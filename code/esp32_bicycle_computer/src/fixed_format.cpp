@@ -0,0 +1,218 @@
+/*
+   Fixed Format
+   See fixed_format.h
+ */
+
+#include "fixed_format.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FIXED_TEXT_SIZE 32 // Sign, 19 digits, point, 9 decimals
+
+static const uint32_t fixed_pow5[FIXED_MAX_DECIMALS + 1] = {1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125};
+static const uint64_t fixed_pow10[FIXED_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+// Bit i of the 128 bit number (hi, lo)
+static bool fixed_bit(uint64_t hi, uint64_t lo, int i)
+{
+	return i < 64 ? (lo >> i) & 1 : (hi >> (i - 64)) & 1;
+}
+
+// True if one of the bits below bit i is set
+static bool fixed_any_below(uint64_t hi, uint64_t lo, int i)
+{
+	if (i <= 64)
+	{
+		return i == 64 ? lo != 0 : (lo & ((1ULL << i) - 1)) != 0;
+	}
+	return lo != 0 || (hi & ((1ULL << (i - 64)) - 1)) != 0;
+}
+
+// |value| * 10^decimals, rounded like printf
+// The double is mantissa * 2^exponent, so the exact product is mantissa * 5^decimals * 2^(exponent + decimals)
+// Returns false if the result doesn't fit into 63 bits (or for nan / inf)
+static bool fixed_scale(double value, uint8_t decimals, uint64_t *result)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int exponent = (bits >> 52) & 0x7FF;
+	uint64_t mantissa = bits & ((1ULL << 52) - 1);
+	if (exponent == 0x7FF)
+	{
+		return false;
+	}
+	if (exponent == 0)
+	{ // Zero or subnormal
+		exponent = 1;
+	}
+	else
+	{
+		mantissa |= 1ULL << 52;
+	}
+	int shift = exponent - 1075 + decimals;
+
+	// mantissa (53 bit) * 5^decimals (21 bit) as 128 bit number
+	uint64_t low = (mantissa & 0xFFFFFFFF) * fixed_pow5[decimals];
+	uint64_t high = (mantissa >> 32) * fixed_pow5[decimals];
+	uint64_t lo = low + (high << 32);
+	uint64_t hi = (high >> 32) + (lo < low);
+
+	if (shift >= 0)
+	{
+		if (hi != 0 || shift >= 63 || (lo >> (63 - shift)) != 0)
+		{
+			return false;
+		}
+		*result = lo << shift;
+		return true;
+	}
+
+	int k = -shift;
+	if (k > 75)
+	{ // The product has less than 75 bits, so it is below one half
+		*result = 0;
+		return true;
+	}
+	uint64_t q;
+	if (k >= 64)
+	{
+		q = hi >> (k - 64);
+	}
+	else
+	{
+		if ((hi >> k) != 0)
+		{
+			return false;
+		}
+		q = (lo >> k) | (hi << (64 - k));
+	}
+
+	// Round to nearest, exact ties to even
+	if (fixed_bit(hi, lo, k - 1) && (fixed_any_below(hi, lo, k - 1) || (q & 1)))
+	{
+		q++;
+	}
+	if (q >> 63)
+	{
+		return false;
+	}
+	*result = q;
+	return true;
+}
+
+// Digits of value with at least min_digits (leading zeros), returns the length
+static int fixed_digits(char *out, uint64_t value, int min_digits)
+{
+	char reversed[20];
+	int n = 0;
+	do
+	{
+		reversed[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0 || n < min_digits);
+	for (int i = 0; i < n; i++)
+	{
+		out[i] = reversed[n - 1 - i];
+	}
+	return n;
+}
+
+void fixed_writer_init(fixed_writer_struct *w, char *buffer, size_t size)
+{
+	w->buffer = buffer;
+	w->size = size;
+	w->length = 0;
+	if (size > 0)
+	{
+		buffer[0] = '\0';
+	}
+}
+
+// Appends length characters, cut off at the end of the buffer
+static void fixed_append(fixed_writer_struct *w, const char *text, size_t length)
+{
+	if (w->length + 1 < w->size)
+	{
+		size_t space = w->size - 1 - w->length;
+		size_t n = length < space ? length : space;
+		memcpy(w->buffer + w->length, text, n);
+		w->buffer[w->length + n] = '\0';
+	}
+	w->length += length;
+}
+
+// Appends sign and digits padded to width
+static void fixed_append_padded(fixed_writer_struct *w, char sign, const char *digits, int length, uint8_t width, bool zero_pad)
+{
+	int padding = width - length - (sign ? 1 : 0);
+	for (; !zero_pad && padding > 0; padding--)
+	{
+		fixed_append_char(w, ' ');
+	}
+	if (sign)
+	{
+		fixed_append_char(w, sign);
+	}
+	for (; padding > 0; padding--)
+	{
+		fixed_append_char(w, '0');
+	}
+	fixed_append(w, digits, length);
+}
+
+// Values the integer path can't handle, kept out of fixed_append_double() because of the stack
+static void __attribute__((noinline)) fixed_append_printf(fixed_writer_struct *w, double value, uint8_t decimals, uint8_t width, uint8_t flags)
+{
+	char text[FIXED_TEXT_SIZE + 320]; // DBL_MAX has 309 digits
+	int length = snprintf(text, sizeof(text), (flags & FIXED_PLUS) ? "%+*.*f" : "%*.*f", width, decimals, value);
+	fixed_append(w, text, length < (int)sizeof(text) ? length : sizeof(text) - 1);
+}
+
+void fixed_append_double(fixed_writer_struct *w, double value, uint8_t decimals, uint8_t width, uint8_t flags)
+{
+	uint64_t scaled;
+	if (decimals > FIXED_MAX_DECIMALS || !fixed_scale(value, decimals, &scaled))
+	{
+		fixed_append_printf(w, value, decimals, width, flags);
+		return;
+	}
+
+	char digits[FIXED_TEXT_SIZE];
+	int length = fixed_digits(digits, scaled / fixed_pow10[decimals], 1);
+	if (decimals > 0)
+	{
+		digits[length++] = '.';
+		length += fixed_digits(digits + length, scaled % fixed_pow10[decimals], decimals);
+	}
+	char sign = signbit(value) ? '-' : ((flags & FIXED_PLUS) ? '+' : 0);
+	fixed_append_padded(w, sign, digits, length, width, false);
+}
+
+void fixed_append_int(fixed_writer_struct *w, long value, uint8_t width, uint8_t flags)
+{
+	char digits[FIXED_TEXT_SIZE];
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : value;
+	int length = fixed_digits(digits, magnitude, 1);
+	char sign = value < 0 ? '-' : ((flags & FIXED_PLUS) ? '+' : 0);
+	fixed_append_padded(w, sign, digits, length, width, flags & FIXED_ZERO_PAD);
+}
+
+void fixed_append_text(fixed_writer_struct *w, const char *text)
+{
+	fixed_append(w, text, strlen(text));
+}
+
+void fixed_append_char(fixed_writer_struct *w, char c)
+{
+	fixed_append(w, &c, 1);
+}
+
+int fixed_format(char *buffer, size_t size, double value, uint8_t decimals, uint8_t width, uint8_t flags)
+{
+	fixed_writer_struct w;
+	fixed_writer_init(&w, buffer, size);
+	fixed_append_double(&w, value, decimals, width, flags);
+	return w.length;
+}
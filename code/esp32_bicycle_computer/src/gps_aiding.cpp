@@ -0,0 +1,98 @@
+/*
+   GPS Aiding
+   See gps_aiding.h
+ */
+
+#include "gps_aiding.h"
+#include "log_chunk.h" // log_crc32()
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+static uint32_t gps_aiding_crc(const gps_aiding_struct *a)
+{
+	return log_crc32(0, a, offsetof(gps_aiding_struct, crc));
+}
+
+void gps_aiding_set(gps_aiding_struct *a, double lat, double lng, double altitude, uint32_t time, double hdop, uint8_t satellites)
+{
+	memset(a, 0, sizeof(gps_aiding_struct)); // The padding is covered by the CRC too
+	a->magic = GPS_AIDING_MAGIC;
+	a->lat = lround(lat * 1e7);
+	a->lng = lround(lng * 1e7);
+	a->altitude = lround(altitude * 100);
+	a->time = time;
+	a->hdop = hdop < 0 ? 0 : (hdop > 655 ? 65535 : lround(hdop * 100));
+	a->satellites = satellites;
+	a->crc = gps_aiding_crc(a);
+}
+
+bool gps_aiding_valid(const gps_aiding_struct *a)
+{
+	return a->magic == GPS_AIDING_MAGIC && a->crc == gps_aiding_crc(a) && a->lat >= -900000000 && a->lat <= 900000000 &&
+		   a->lng >= -1800000000 && a->lng <= 1800000000;
+}
+
+void gps_aiding_date(uint32_t time, uint16_t *year, uint8_t *month, uint8_t *day, uint8_t *hour, uint8_t *minute, uint8_t *second)
+{
+	uint32_t days = time / 86400;
+	uint32_t rest = time % 86400;
+	*hour = rest / 3600;
+	*minute = rest / 60 % 60;
+	*second = rest % 60;
+
+	// Days since 01.03.1600, so the leap day is the last day of a year and the 400 year cycles start at 0
+	uint32_t d = days + 146097 - 60;
+	uint32_t era = d / 146097;
+	uint32_t day_of_era = d % 146097;
+	uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	uint32_t m = (5 * day_of_year + 2) / 153; // 0 = March
+	*day = day_of_year - (153 * m + 2) / 5 + 1;
+	*month = m < 10 ? m + 3 : m - 9;
+	*year = 1600 + era * 400 + year_of_era + (*month <= 2 ? 1 : 0);
+}
+
+size_t gps_aiding_frames(const gps_aiding_struct *a, uint32_t now, uint16_t now_ms, double pos_margin, uint8_t *out, size_t size)
+{
+	if (!gps_aiding_valid(a))
+	{
+		return 0;
+	}
+
+	ubx_mga_ini_pos_llh_struct pos;
+	memset(&pos, 0, sizeof(pos));
+	pos.type = UBX_MGA_INI_POS_LLH;
+	pos.lat = a->lat;
+	pos.lon = a->lng;
+	pos.alt = a->altitude;
+	double accuracy = a->hdop / 100.0 * GPS_AIDING_UERE + pos_margin;
+	pos.pos_acc = accuracy > 2e7 ? 2000000000UL : (uint32_t)(accuracy * 100 + 0.5);
+	size_t length = ubx_frame(UBX_CLASS_MGA, UBX_MGA_INI, &pos, sizeof(pos), out, size);
+	if (length == 0 || now < a->time)
+	{ // The clock has been reset (or lost its time)
+		return length;
+	}
+
+	ubx_mga_ini_time_utc_struct utc;
+	memset(&utc, 0, sizeof(utc));
+	utc.type = UBX_MGA_INI_TIME_UTC;
+	utc.leap_secs = -128;
+	uint16_t year; // The fields of the packed struct can't be passed by pointer
+	uint8_t month, day, hour, minute, second;
+	gps_aiding_date(now, &year, &month, &day, &hour, &minute, &second);
+	utc.year = year;
+	utc.month = month;
+	utc.day = day;
+	utc.hour = hour;
+	utc.minute = minute;
+	utc.second = second;
+	utc.ns = (now_ms % 1000) * 1000000UL;
+	double drift = (now - a->time) * GPS_AIDING_RTC_PPM * 1e-6;
+	double t_acc = 1.0 + drift;
+	utc.t_acc_s = t_acc > 65535 ? 65535 : (uint16_t)t_acc;
+	double t_acc_ns = t_acc > 65535 ? 0 : ceil((t_acc - utc.t_acc_s) * 1e9); // Rounded up, the accuracy must not be too optimistic
+	utc.t_acc_ns = t_acc_ns > 999999999 ? 999999999 : (uint32_t)t_acc_ns;
+	return length + ubx_frame(UBX_CLASS_MGA, UBX_MGA_INI, &utc, sizeof(utc), out + length, size - length);
+}
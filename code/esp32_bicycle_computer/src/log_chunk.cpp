@@ -0,0 +1,108 @@
+/*
+   Log Chunks
+   See log_chunk.h
+ */
+
+#include "log_chunk.h"
+
+#include <stdio.h>
+#include <string.h>
+
+uint32_t log_crc32(uint32_t crc, const void *data, size_t length)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	crc = ~crc;
+	while (length--)
+	{
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+void log_chunk_begin(log_chunk_struct *c, uint32_t index)
+{
+	memset(c, 0, sizeof(log_chunk_struct));
+	c->index = index;
+}
+
+void log_chunk_add_fix(log_chunk_struct *c, uint32_t time, double lat, double lng, double distance_km)
+{
+	if (c->rows == 0)
+	{
+		c->first_time = time;
+		c->lat_min = c->lat_max = lat;
+		c->lng_min = c->lng_max = lng;
+		c->first_distance = distance_km;
+	}
+	else
+	{
+		if (lat < c->lat_min)
+			c->lat_min = lat;
+		if (lat > c->lat_max)
+			c->lat_max = lat;
+		if (lng < c->lng_min)
+			c->lng_min = lng;
+		if (lng > c->lng_max)
+			c->lng_max = lng;
+	}
+	c->last_time = time;
+	c->last_distance = distance_km;
+	c->rows++;
+}
+
+void log_chunk_add_data(log_chunk_struct *c, const void *data, size_t length)
+{
+	c->crc = log_crc32(c->crc, data, length);
+	c->length += length;
+}
+
+size_t log_chunk_free(const log_chunk_struct *c)
+{
+	return LOG_CHUNK_DATA_SIZE - c->length;
+}
+
+void log_chunk_format_header(const log_chunk_struct *c, char *buffer)
+{
+	int length = snprintf(buffer, LOG_CHUNK_HEADER_SIZE, "#CHUNK,%lu,%lu,%lu,%.7f,%.7f,%.7f,%.7f,%.3f,%.3f,%lu,%lu,%08lX",
+						  (unsigned long)c->index, (unsigned long)c->first_time, (unsigned long)c->last_time,
+						  c->lat_min, c->lat_max, c->lng_min, c->lng_max,
+						  c->first_distance, c->last_distance,
+						  (unsigned long)c->rows, (unsigned long)c->length, (unsigned long)c->crc);
+	if (length < 0 || length > LOG_CHUNK_HEADER_SIZE - 1)
+	{
+		length = LOG_CHUNK_HEADER_SIZE - 1;
+	}
+
+	// Pad with spaces
+	memset(buffer + length, ' ', LOG_CHUNK_HEADER_SIZE - 1 - length);
+	buffer[LOG_CHUNK_HEADER_SIZE - 1] = '\n';
+}
+
+bool log_chunk_parse_header(const char *buffer, log_chunk_struct *c)
+{
+	unsigned long index, first_time, last_time, rows, length, crc;
+
+	if (strncmp(buffer, "#CHUNK,", 7) != 0)
+	{
+		return false;
+	}
+	if (sscanf(buffer + 7, "%lu,%lu,%lu,%lf,%lf,%lf,%lf,%lf,%lf,%lu,%lu,%lX",
+			   &index, &first_time, &last_time,
+			   &c->lat_min, &c->lat_max, &c->lng_min, &c->lng_max,
+			   &c->first_distance, &c->last_distance,
+			   &rows, &length, &crc) != 12)
+	{
+		return false;
+	}
+	c->index = index;
+	c->first_time = first_time;
+	c->last_time = last_time;
+	c->rows = rows;
+	c->length = length;
+	c->crc = crc;
+	return true;
+}
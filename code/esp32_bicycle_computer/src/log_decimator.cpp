@@ -0,0 +1,76 @@
+/*
+   Log Decimator
+   See log_decimator.h
+ */
+
+#include "log_decimator.h"
+#include "geodesic.h"
+
+void log_decimator_init(log_decimator_struct *d, double distance, double heading, double heading_distance, uint32_t max_interval)
+{
+	d->distance = distance;
+	d->heading = heading;
+	d->heading_distance = heading_distance;
+	d->max_interval = max_interval;
+
+	d->started = 0;
+	d->last_lat = 0;
+	d->last_lng = 0;
+	d->last_time = 0;
+	d->last_heading = 0;
+	d->heading_valid = 0;
+	d->heading_lat = 0;
+	d->heading_lng = 0;
+	d->current_heading = 0;
+
+	d->kept = 0;
+	d->dropped = 0;
+}
+
+// Difference of two headings (0..180 degrees)
+static double log_decimator_heading_diff(double a, double b)
+{
+	double diff = fabs(a - b);
+	return diff > 180 ? 360 - diff : diff;
+}
+
+bool log_decimator_keep(log_decimator_struct *d, uint32_t time, double lat, double lng)
+{
+	bool keep = !d->started || time - d->last_time >= d->max_interval ||
+				geo_equirectangular_m(d->last_lat, d->last_lng, lat, lng) >= d->distance;
+
+	if (!d->started)
+	{
+		d->heading_lat = lat;
+		d->heading_lng = lng;
+	}
+	else if (geo_equirectangular_m(d->heading_lat, d->heading_lng, lat, lng) >= d->heading_distance)
+	{
+		d->current_heading = geo_bearing_deg(d->heading_lat, d->heading_lng, lat, lng);
+		d->heading_lat = lat;
+		d->heading_lng = lng;
+		if (!d->heading_valid)
+		{ // First heading after the start, it belongs to the first kept fix
+			d->heading_valid = 1;
+			d->last_heading = d->current_heading;
+		}
+		else if (log_decimator_heading_diff(d->current_heading, d->last_heading) >= d->heading)
+		{
+			keep = 1;
+		}
+	}
+
+	if (!keep)
+	{
+		d->dropped++;
+		return 0;
+	}
+
+	d->started = 1;
+	d->last_lat = lat;
+	d->last_lng = lng;
+	d->last_time = time;
+	d->last_heading = d->current_heading;
+	d->kept++;
+	return 1;
+}
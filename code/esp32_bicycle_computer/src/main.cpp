@@ -21,12 +21,33 @@
 #include <sdios.h>
 
 #include <Time.h>
+#include <esp_system.h>
+#include <driver/ledc.h>
 
 #ifdef ENABLE_PREFERENCES
 #include <Preferences.h>
 #endif
 
+#ifdef ENABLE_PARKING
+#include <esp_sleep.h>
+#include <driver/rtc_io.h>
+#endif
+
 #include "bicycle_computer_config.h"
+#include "climb_analytics.h"
+#include "ride_index.h"
+#include "log_chunk.h"
+#include "battery_monitor.h"
+#include "debug_log.h"
+#include "telemetry.h"
+#include "geodesic.h"
+#include "track_codec.h"
+#include "fixed_format.h"
+#include "rtc_track.h"
+#include "ubx.h"
+#include "gps_aiding.h"
+#include "motion.h"
+#include "log_decimator.h"
 
 #ifdef ENABLE_OTA
 #include <WiFi.h>
@@ -49,22 +70,170 @@ const int resolution = 8;
 // Variables
 byte gui_selection = 0;
 float humid = 0, temp = 0;
-int ldr_reading = 0;
-int pwm_value = 2550;
+bool sensors_read = 0; // temp and humid hold a reading (read_sensors() ran after the sensor was started)
+int ldr_reading = 0; // Filtered
+int pwm_value = 0;
 String sensor_comb;
 String time_comb;
 String date_comb;
 bool time_sync_flag = 0;
 char daysOfTheWeek[7][12] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
-unsigned int seconds_running = 0;
+volatile unsigned int seconds_running = 0; // Counted by clock_isr()
 String time_running;
 
+/*
+Software clock
+The time is read from the DS3231 once at boot (and set after a GPS sync).
+Afterwards it is advanced by the 1Hz square wave of the RTC, so reading it causes no I2C traffic.
+*/
+volatile uint32_t clock_seconds = 0;		 // Seconds since 2000 (local time)
+volatile unsigned long clock_last_edge = 0; // millis() of the last square wave edge
+
 unsigned long loop_timing = 0;
 unsigned long loop_timing_2 = 0;
 unsigned long loop_timing_3 = 0;
 
+volatile bool sensors_ready = 0; // Set by sensor_init_task()
+volatile bool sd_init_done = 0;	  // Set by sd_supervisor_task() after the first mount attempt
+bool first_speed_display = 0;
+
+/*
+Boot profiler
+Every stage of the startup is marked with its time since boot.
+The table is printed once all background tasks are done.
+*/
+#define BOOT_PROFILE_STAGES 12
+struct boot_profile_struct
+{
+	const char *stage[BOOT_PROFILE_STAGES];
+	unsigned long time[BOOT_PROFILE_STAGES]; // us since boot
+	byte count;
+	bool printed;
+};
+boot_profile_struct boot_profile;
+
+/*
+Deferred debug log (see debug_log.h)
+The LOG_* macros push an event, debug_log_task() prints it.
+All arguments are int32_t values printed with %ld. Fractional values are scaled by the caller
+(e.g. cm instead of m) and the format string names the unit.
+*/
+enum debug_log_id_enum
+{
+	LOG_ID_TIME_SYNCED,
+	LOG_ID_STORE_DIST,
+	LOG_ID_STORE_SPEED,
+	LOG_ID_STORE_ALT,
+	LOG_ID_STORE_SAT,
+	LOG_ID_PATH_LINE,
+	LOG_ID_PATH_BOUNDS,
+	LOG_ID_PATH_SPAN,
+	LOG_ID_SD_CARD_SIZE,
+	LOG_ID_SD_BACKLOG,
+	LOG_ID_SD_FILE_EXISTS,
+	LOG_ID_SD_OPEN,
+	LOG_ID_SD_RIDE_INDEX,
+	LOG_ID_SD_TIMESTAMP,
+	LOG_ID_SCREEN,
+	LOG_ID_BUTTON_LATENCY,
+	LOG_ID_LCD_TIMING,
+	LOG_ID_UI_TIMING,
+	LOG_ID_TRACK_BLOCK,
+	LOG_ID_TRACK_WRITE,
+	LOG_ID_RTC_TRACK,
+	LOG_ID_PARK,
+	LOG_ID_PARK_SYNC,
+	LOG_ID_PARK_WAKE,
+	LOG_ID_GPS_AIDING,
+	LOG_ID_GPS_TTFF,
+	LOG_ID_GPS_RX,
+	LOG_ID_GPS_RX_LOST,
+	LOG_ID_MOTION,
+	LOG_ID_LOG_DECIMATION,
+	LOG_ID_SD_RESUMED,
+	LOG_ID_SD_STARTED,
+	LOG_ID_SD_START_FAILED,
+	LOG_ID_SD_FILE_NAME,
+	LOG_ID_COUNT
+};
+
+const char *const debug_log_formats[] = {
+	"Time synced",
+	"Logging dist (%ldm)",
+	"Logging speed (%ldm/h)",
+	"Logging alt (%ldm)",
+	"Logging sat (%ld)",
+	"Path line %ld|%ld -> %ld|%ld",
+	"Path x: %ld..%ld, y: %ld..%ld (1/100)",
+	"Path span x: %ld, y: %ld (1/100)",
+	"Card Size: %ldMB",
+	"SD backlog written: %ld rows (%ld dropped)",
+	"Error file already exists!",
+	"Error while opening file!",
+	"Error while writing ride index!",
+	"Set timestamp %ld failed (0 create, 1 write, 2 access)",
+	"Screen: %ld",
+	"Button to screen: %ldus (max. %ldus)",
+	"LCD: send %ldus per frame",
+	"UI: compose %ldus, queue %ldus, %ld pages per 10 frames",
+	"Track block %ld: %ld fixes, %ld bytes, encoding %ldus per fix",
+	"Error while writing track block %ld!",
+	"RTC track: %ld unwritten fixes restored (%ld lost)",
+	"Parking after %lds without movement",
+	"Parking: SD card not synced in time",
+	"Woken up from parking (cause %ld), setup done after %ldms",
+	"GPS aiding sent (%ld bytes, time %ld)",
+	"GPS first fix after %ldms (aided %ld)",
+	"GPS RX: %ld sentences, %ld failed checksums, max. %ld bytes buffered",
+	"GPS RX lost data: %ld FIFO / %ld buffer overflows, %ld framing errors",
+	"Motion: %ld (0 moving, 1 slow, 2 stopped, 3 parked), spread %ldcm",
+	"Log decimation: %ld fixes logged, %ld dropped",
+	"SD logging resumed (chunk %ld, %ld bytes)",
+	"SD logging started successfully!",
+	"Error while starting SD logging!",
+	"Log file name set (%ld characters)",
+};
+static_assert(sizeof(debug_log_formats) / sizeof(debug_log_formats[0]) == LOG_ID_COUNT, "Every log id needs a format");
+
+debug_log_struct debug_log;
+
+#ifdef ENABLE_TELEMETRY
+// Telemetry stream (see telemetry.h)
+unsigned long telemetry_dropped = 0; // Frames that didn't fit into the TX buffer, sent from both cores
+portMUX_TYPE telemetry_mux = portMUX_INITIALIZER_UNLOCKED; // Guards telemetry_dropped
+unsigned long loop_count = 0;
+#endif
+
+#if DEBUG_LOG_LEVEL >= DEBUG_LOG_LEVEL_ERROR
+#define LOG_ERROR(id, ...) debug_log_push(&debug_log, millis(), DEBUG_LOG_LEVEL_ERROR, id, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(id, ...)
+#endif
+#if DEBUG_LOG_LEVEL >= DEBUG_LOG_LEVEL_WARN
+#define LOG_WARN(id, ...) debug_log_push(&debug_log, millis(), DEBUG_LOG_LEVEL_WARN, id, ##__VA_ARGS__)
+#else
+#define LOG_WARN(id, ...)
+#endif
+#if DEBUG_LOG_LEVEL >= DEBUG_LOG_LEVEL_INFO
+#define LOG_INFO(id, ...) debug_log_push(&debug_log, millis(), DEBUG_LOG_LEVEL_INFO, id, ##__VA_ARGS__)
+#else
+#define LOG_INFO(id, ...)
+#endif
+#if DEBUG_LOG_LEVEL >= DEBUG_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(id, ...) debug_log_push(&debug_log, millis(), DEBUG_LOG_LEVEL_DEBUG, id, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(id, ...)
+#endif
+
+// The LCD and the SD card share the SPI bus (see spi_bus_task())
+SemaphoreHandle_t spi_mutex;
+// The only tasks that may access the SD card (checked by sd_bus_begin())
+TaskHandle_t spi_bus_task_handle = NULL;
+TaskHandle_t sd_supervisor_task_handle = NULL;
+
 volatile bool button_data = 0;
 volatile unsigned long button_timing = 0;
+volatile unsigned long button_press_us = 0; // For the button to screen latency
 
 #ifdef USE_RFID
 unsigned long rfid_unlock[5] = {1891469948, 3204651, 2771751097, 2247910361, 4067332910};
@@ -98,6 +267,10 @@ struct stat_display_data_struct
 	double avg_humid;
 
 	double total_dist;
+
+	// Current ride
+	double ride_max_speed;
+	unsigned long moving_time; // ms while moving (see motion.h)
 };
 
 struct gps_mapper_struct
@@ -135,11 +308,296 @@ String filename;
 char fileName[33];
 #warning the size of fileName is restricted here!
 
-bool SD_present = 0;
+volatile bool SD_present = 0;
 unsigned long sd_log_count = 0;
+#ifdef ENABLE_LOG_DECIMATION
+log_decimator_struct log_decimator; // Drops fixes that add nothing to the track
+#endif
+log_chunk_struct log_chunk; // Summary of the chunk that is currently written
+
+// One fix, formatted as a CSV row plus the data for the chunk summary
+struct log_record_struct
+{
+	uint32_t time; // Seconds since 2000
+	double lat;
+	double lng;
+	double distance_km;
+	uint32_t seq; // Sequence number in the RTC track (see rtc_track.h)
+#ifdef ENABLE_TRACK_COMPRESSION
+	track_fix_struct fix; // The same fix for the compressed track
+#endif
+	uint16_t length; // Length of the row
+	char row[LOG_ROW_SIZE];
+};
+#define LOG_RECORD_HEADER_SIZE offsetof(log_record_struct, row)
+
+/*
+SD supervisor
+While the card is missing (or after a failed write) the rows are kept in a RAM ring buffer.
+The supervisor task probes the card, remounts it, opens a continuation file and drains the backlog.
+If the buffer is full, the oldest rows are dropped.
+*/
+enum sd_state_enum
+{
+	SD_STATE_MISSING,  // No card / write error, rows go to the backlog
+	SD_STATE_MOUNTING, // Trying to mount the card
+	SD_STATE_DRAINING, // Writing the backlog
+	SD_STATE_OK
+};
+volatile sd_state_enum sd_state = SD_STATE_MISSING;
+
+uint8_t sd_backlog[SD_BACKLOG_SIZE];
+size_t backlog_head = 0; // Write position
+size_t backlog_tail = 0; // Read position
+size_t backlog_used = 0; // Bytes
+unsigned int backlog_rows = 0;
+unsigned long backlog_dropped = 0;
+portMUX_TYPE backlog_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+SPI bus task
+LCD page transfers and SD writes are queued and executed by one task on core 0,
+which is the only place (besides the SD supervisor) that selects a device on the bus.
+LCD transfers have priority, they are short and visible. The loop only copies the data.
+
+The frame buffer of u8g2 is the back buffer, it is rendered on core 1 (loop).
+Finished pages are copied into one of LCD_TX_BUFFERS front buffers, which are sent on core 0
+while the next frame is rendered.
+*/
+enum spi_sd_request_enum
+{
+	SPI_SD_ROW,	  // Write a row (or buffer it while the card is missing)
+	SPI_SD_INDEX, // Rewrite the chunk header, flush and update the ride index
+	SPI_SD_PARK,  // Like SPI_SD_INDEX, then turn the LCD off and stop (deep sleep follows, see park_enter())
+#ifdef ENABLE_HISTORY_DISPLAY
+	SPI_SD_HISTORY, // Update the ride index and read the newest rides for the history screen
+#endif
+};
+
+struct spi_sd_request_struct
+{
+	byte type;
+	log_record_struct record;
+};
+
+#define LCD_ALL_PAGES 0xFF
+#define LCD_TX_BUFFERS 2
+
+struct lcd_request_struct
+{
+	byte pages;				 // Bit mask
+	byte buffer;			 // Index of the front buffer
+	unsigned long input_us;	 // Time of the button press this frame answers (0 if none)
+};
+
+struct lcd_timing_struct
+{
+	unsigned long send_us;
+	unsigned int frames;
+	unsigned long latency_us; // Button press to frame on the LCD (last)
+	unsigned long latency_max_us;
+};
+
+uint8_t lcd_tx_buffer[LCD_TX_BUFFERS][1024]; // Front buffers (only the queued pages are valid)
+byte lcd_tx_next = 0;						 // Front buffer of the next frame
+SemaphoreHandle_t lcd_tx_free;				 // Counts the free front buffers
+byte lcd_pending_pages = 0;					 // Pages that could not be queued yet
+unsigned long lcd_input_us = 0;				 // Button press that the next frame answers
+lcd_timing_struct lcd_timing;
+QueueHandle_t spi_lcd_queue;				 // lcd_request_struct
+QueueHandle_t spi_sd_queue;		   // spi_sd_request_struct
+SemaphoreHandle_t spi_request_signal; // Counts queued requests
+portMUX_TYPE checkpoint_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+Checkpoint of the current ride
+Kept in RTC memory, which survives software, watchdog and brownout resets and deep sleep (but not a power cycle).
+It is updated after every log write, so after a reset the ride can continue in the same file.
+*/
+struct checkpoint_struct
+{
+	uint32_t magic;
+	uint32_t version;
+
+	// Log file
+	bool log_valid; // The fields below describe a log file whose first chunk header was written (see save_log_position())
+	char file_name[33];
+	uint32_t ride_index_pos;
+	uint32_t ride_start_time;
+	log_chunk_struct log_chunk; // Position in the file = chunk start + header + log_chunk.length
+
+	// Trip state
+	double travel_distance_km;
+	double last_lat;
+	double last_lng;
+	double avg_speed;
+	double ride_max_speed;
+	unsigned long moving_time;
+	unsigned int seconds_running;
+	climb_struct climb;
+
+	uint32_t crc; // CRC32 of everything above
+};
+#define CHECKPOINT_MAGIC 0x50484B43 // "CKHP"
+#define CHECKPOINT_VERSION 2
+
+RTC_NOINIT_ATTR checkpoint_struct checkpoint;
+bool ride_resumed = 0; // Trip state was restored from the checkpoint
+
+// The last fixes until their rows are on the card, they are written after a reset (see rtc_track.h)
+RTC_NOINIT_ATTR rtc_track_struct rtc_track;
+
+#ifdef ENABLE_PARKING
+/*
+Parking
+Once the motion state is parked (MOTION_PARK_TIME ms stopped, a button press restarts it) the computer goes to deep sleep (see park_enter()).
+The trip is in RTC memory (checkpoint and RTC track), so after the wake-up setup() continues it like after a reset.
+*/
+esp_sleep_wakeup_cause_t park_wakeup;  // ESP_SLEEP_WAKEUP_UNDEFINED if this wasn't a wake-up from parking
+bool park_check = 0;		   // Woken up by the timer: the display stays off until the bike moves or the button is pressed
+SemaphoreHandle_t park_ready; // Given by the SPI bus task once the card is synced and the LCD is off
+#endif
+
+// Ride index
+uint32_t ride_index_pos = 0; // Position of the entry of the current ride inside the index file
+uint32_t ride_start_time = 0;
+unsigned long last_ride_index_update = 0;
+#ifdef ENABLE_HISTORY_DISPLAY
+// Read by the SPI bus task (SPI_SD_HISTORY), the loop only draws them
+enum history_state_enum
+{
+	HISTORY_LOADING,
+	HISTORY_READY,
+	HISTORY_NO_CARD
+};
+ride_index_entry_struct history[HISTORY_RIDES]; // Newest ride first
+byte history_count = 0;
+volatile byte history_state = HISTORY_LOADING;
+volatile uint32_t history_version = 0; // Incremented by the SPI bus task after every load
+uint32_t history_drawn_version = 0;
+portMUX_TYPE history_mux = portMUX_INITIALIZER_UNLOCKED; // Guards history[] and history_count
+#endif
+
+/*
+GPS start
+The time to first fix (TTFF) after boot is measured and logged.
+With ENABLE_GPS_AIDING the last good fix is kept in RTC memory (and with ENABLE_PREFERENCES in the flash)
+and sent to the receiver as soon as it talks (see gps_aiding.h).
+*/
+unsigned long gps_ttff = 0; // ms from boot to the first fix, 0 until then
+byte gps_aiding_sent = 0;	// Number of aiding frames sent
+#ifdef ENABLE_GPS_AIDING
+RTC_NOINIT_ATTR gps_aiding_struct gps_aiding;
+bool gps_aiding_done = 0;
+unsigned long gps_aiding_saved = 0; // millis() of the last write to the flash
+#endif
+
+/*
+GPS receive statistics
+The UART driver reports overflows of its hardware FIFO and of the receive ring (GPS_RX_BUFFER) and framing errors,
+TinyGPS++ counts the sentences with a good and a bad checksum. Lost bytes break a sentence, so as long as
+all of these (except the passed checksums) stay at 0, no fix was lost.
+*/
+struct gps_diag_struct
+{
+	volatile uint32_t fifo_overflows;	// Set by the UART event task (gps_uart_error())
+	volatile uint32_t buffer_overflows;
+	volatile uint32_t framing_errors; // Framing, parity and break
+	int max_buffered;				  // Highest fill level of the receive ring seen by update_gps()
+	uint32_t logged_lost;			  // Overflows and framing errors when they were last logged
+	unsigned long last_log;
+};
+gps_diag_struct gps_diag;
 
 gps_data_struct gps_data;
 gps_mapper_struct mapper;
+// Gates distance, path, log and display refresh, so GPS jitter while standing doesn't count (see motion.h)
+motion_struct motion;
+byte motion_logged_state = MOTION_STOPPED;
+unsigned long last_sensor_read = 0;
+climb_struct climb;
+battery_struct battery;
+unsigned long last_battery_sample = 0;
+
+/*
+Retained UI (see ui_init())
+*/
+#define UI_BUFFER_SIZE 1024		// 128x64 pixels
+#define UI_TEXT_SIZE 48
+#define UI_SPEED_BASELINE 53	// Baseline of the speed digits
+#define UI_SPEED_FIRST_PAGE 3	// The speed digits cover the pages 3..6 (rows 24..55)
+#define UI_SPEED_PAGES 4
+#define UI_GLYPH_MAX_WIDTH 24
+#define UI_TIMING_FRAMES 120	// Number of frames the render timing is averaged over
+
+struct ui_glyph_struct
+{
+	byte width; // Advance
+	uint8_t columns[UI_SPEED_PAGES][UI_GLYPH_MAX_WIDTH];
+};
+
+// Last text of every widget of the main screen
+struct ui_main_struct
+{
+	char satellites[UI_TEXT_SIZE];
+	char battery[UI_TEXT_SIZE];
+	char sd[UI_TEXT_SIZE];
+	char runtime[UI_TEXT_SIZE];
+	char time[UI_TEXT_SIZE];
+	char sensor[UI_TEXT_SIZE];
+	char speed[UI_TEXT_SIZE];
+	char distance[UI_TEXT_SIZE];
+	char avg_speed[UI_TEXT_SIZE];
+};
+
+struct ui_timing_struct
+{
+	unsigned long compose_us;
+	unsigned long send_us;
+	unsigned long pages;
+	unsigned int frames;
+};
+
+const char ui_speed_chars[] = "0123456789.-";
+ui_glyph_struct ui_speed_glyphs[sizeof(ui_speed_chars) - 1];
+uint8_t ui_chrome[UI_BUFFER_SIZE];
+ui_main_struct ui_main;
+ui_timing_struct ui_timing;
+bool ui_valid = 0; // Buffer contains the main screen
+byte ui_dirty_pages = 0;
+
+/*
+Screens
+Every screen declares when it has to be redrawn:
+SCREEN_REFRESH_PERIODIC		every refresh_interval ms
+SCREEN_REFRESH_ON_CHANGE	when data it depends on changed (at most every refresh_interval ms)
+SCREEN_REFRESH_ON_ENTER		only when it is selected
+Every screen is drawn when it is selected, the registry is in the GUI section.
+*/
+enum screen_refresh_enum
+{
+	SCREEN_REFRESH_PERIODIC,
+	SCREEN_REFRESH_ON_CHANGE,
+	SCREEN_REFRESH_ON_ENTER
+};
+
+// Data a screen can depend on
+#define SCREEN_DATA_PATH (1 << 0)	 // New segment in the GPS path
+#define SCREEN_DATA_STATS (1 << 1)	 // Maximum values, total distance, ascent, temperature or humidity
+#define SCREEN_DATA_HISTORY (1 << 2) // The rides of the history screen were loaded
+
+struct screen_struct
+{
+	const char *name;
+	void (*draw)();
+	void (*enter)(); // Called before the screen is drawn for the first time (optional)
+	screen_refresh_enum refresh;
+	unsigned int refresh_interval; // ms
+	uint16_t depends;			   // SCREEN_DATA_* flags
+};
+
+uint16_t screen_data_changed = 0; // SCREEN_DATA_* flags set since the last redraw
+unsigned long last_screen_draw = 0;
 
 stat_display_data_struct stats;
 
@@ -150,6 +608,13 @@ RtcDS3231<TwoWire> Rtc(Wire);
 TinyGPSPlus gps;
 SdFat sd;
 SdFile file;
+#ifdef ENABLE_TRACK_COMPRESSION
+// Compressed copy of the log in blocks of TRACK_BLOCK_SIZE (see track_codec.h), written by the SPI bus task
+SdFile track_file;
+track_encoder_struct track_encoder;
+uint32_t track_block_index = 0;	   // Position of the current block in the file
+unsigned long track_encode_us = 0; // Time of the last fix
+#endif
 #ifdef ENABLE_PREFERENCES
 Preferences preferences;
 #endif
@@ -159,14 +624,34 @@ MFRC522 mfrc522(0x28, rfid_reset);
 #endif
 
 // Function declarations
+void boot_profile_mark(const char *stage);
+void boot_profile_print();
+void sensor_init_task(void *parameter);
+void sd_bus_begin();
+void sd_bus_end();
+void debug_log_task(void *parameter);
+#ifdef ENABLE_TELEMETRY
+void telemetry_send(uint8_t type, const void *payload, size_t length);
+void telemetry_send_fix();
+void telemetry_send_sensors();
+void telemetry_send_profile();
+#endif
+// SPI bus task
+void spi_bus_task(void *parameter);
+void lcd_submit(byte pages);
+void sd_submit(byte type, const log_record_struct *record);
 void rfid_lockscreen();
 void IRAM_ATTR button_isr();
+void IRAM_ATTR clock_isr();
+void clock_sync_from_rtc();
+RtcDateTime clock_now();
 void ldr_dimmer();
 String zero_padder(String z_p);
 void on_time_helper(bool create_output);
 void rtc_time();
 void read_sensors();
 float read_battery_voltage();
+void battery_sample();
 
 /*
 Time sync code
@@ -189,15 +674,47 @@ void draw_gps_path();
 void measure_distance_gps();
 void update_gps_data();
 void update_gps();
+void gps_uart_error(hardwareSerial_error_t error);
+void gps_diag_log();
+// TTFF and the saved fix for aiding, called for every new fix
+void gps_fix_update();
+#ifdef ENABLE_GPS_AIDING
+void gps_aiding_load();
+void gps_aiding_send();
+#ifdef ENABLE_PREFERENCES
+void gps_aiding_store();
+#endif
+#endif
 void calc_avg_speed();
-void display_gps_info();
 
 // This function calls the apppropriate GUI drawing function
 void gui_selector();
+// Redraws the selected screen if its refresh policy says so
+void gui_refresh();
+// Selects the next screen
+void gui_next_screen();
+void screen_data_update(uint16_t data);
+#ifdef ENABLE_HISTORY_DISPLAY
+void enter_history();
+#endif
 #ifdef ENABLE_STATS_DISPLAY
 void draw_stats();
 #endif
+#ifdef ENABLE_HISTORY_DISPLAY
+void draw_history();
+#endif
+#ifdef ENABLE_GPS_DIAG_DISPLAY
+void draw_gps_diag();
+#endif
 void update_display();
+// Retained UI of the main screen
+void ui_init();
+void ui_draw_symbols();
+int ui_draw_speed(int x, const char *text);
+bool ui_widget_changed(char *cache, const char *text);
+void ui_clear_box(int x, int y, int w, int h);
+void lcd_print_fixed(const char *prefix, double value, uint8_t decimals, uint8_t flags, const char *suffix);
+void lcd_print_int(const char *prefix, long value, const char *suffix);
 
 #ifdef ENABLE_PREFERENCES
 // Logs total distance to Storage every 10 additional meters
@@ -217,20 +734,67 @@ void init_ota();
 #endif // ENABLE_OTA
 
 // Saves data to SD
-bool sd_log_data();
+void sd_format_row(log_record_struct *record, track_fix_struct *fix);
+void log_fix();
+bool sd_log_data(const log_record_struct *record);
+void sd_row_persisted(const log_record_struct *record);
+// RAM backlog while the SD card is missing
+void backlog_push(const log_record_struct *record);
+bool backlog_peek(log_record_struct *record);
+void backlog_pop();
+bool sd_mount();
+bool sd_drain_backlog();
+void sd_supervisor_task(void *parameter);
+// Chunked log (see log_chunk.h)
+bool sd_write_log(const char *data, size_t length);
+bool sd_reserve_chunk_space(size_t length);
+bool sd_write_chunk_header();
+bool sd_write_csv_header();
+uint32_t gps_time_seconds();
+#ifdef ENABLE_TRACK_COMPRESSION
+// Compressed track (see track_codec.h)
+bool track_log_fix(const track_fix_struct *fix);
+bool track_write_block();
+bool track_open(bool resume);
+#endif
 
 bool init_sd_logger();
+// Ride index (see ride_index.h)
+bool init_ride_index();
+bool continue_ride_index();
+bool update_ride_index();
+#ifdef ENABLE_HISTORY_DISPLAY
+byte load_ride_history(ride_index_entry_struct *entries);
+#endif
 void set_filename();
 bool SD_set_timestamps();
+void fill_ride_index_entry(ride_index_entry_struct *entry);
 String time_comb_helper(bool include_day, bool include_date, bool include_time, bool time_separator);
 
+// Checkpoint (crash-safe logging)
+void save_checkpoint();
+void save_log_position();
+void clear_log_position();
+bool load_checkpoint();
+bool resume_sd_logger();
+void rtc_track_restore();
+void rtc_track_restore_fix(const track_fix_struct *fix, uint32_t seq, void *context);
+
+#ifdef ENABLE_PARKING
+void park_update();
+bool park_activity();
+void park_enter();
+void gps_backup();
+void gps_wake();
+#endif
+
 void setup()
 {
 	pinMode(ldr_pin, INPUT);
 	pinMode(button_pin, INPUT_PULLUP);
 	pinMode(ref_pin, INPUT);
 	pinMode(battery_measure_pin, INPUT);
-	pinMode(rtc_interrupt, INPUT);
+	pinMode(rtc_interrupt, INPUT_PULLUP); // SQW is open drain
 #ifdef USE_RFID
 	pinMode(rfid_reset, OUTPUT);
 #endif
@@ -240,20 +804,71 @@ void setup()
 	// Turn of BLE
 	btStop();
 
+#ifdef ENABLE_PARKING
+	park_wakeup = esp_sleep_get_wakeup_cause();
+	park_ready = xSemaphoreCreateBinary();
+	// The backlight was held off during the deep sleep
+	gpio_hold_dis((gpio_num_t)backlight_pin);
+#endif
+
 	ledcSetup(ledChannel, freq, resolution);
 	ledcAttachPin(backlight_pin, ledChannel);
 	digitalWrite(backlight_pin, LOW);
+	// Brightness changes are faded by the LEDC hardware
+	ledc_fade_func_install(0);
 
+	// The ring has to be large enough for the longest time the loop doesn't read (SD flush, sensors, display)
+	Serial2.setRxBufferSize(GPS_RX_BUFFER);
 	Serial2.begin(GPS_BAUD);
+	Serial2.onReceiveError(gps_uart_error);
+#ifdef ENABLE_PARKING
+	if (park_wakeup != ESP_SLEEP_WAKEUP_UNDEFINED)
+	{
+		gps_wake();
+	}
+#endif
+#ifdef ENABLE_TELEMETRY
+	Serial.begin(TELEMETRY_BAUD);
+#else
 	Serial.begin(PC_SERIAL);
+#endif
+	debug_log_init(&debug_log);
+#if DEBUG_LOG_LEVEL > 0
+	xTaskCreatePinnedToCore(debug_log_task, "debug_log", 4096, NULL, tskIDLE_PRIORITY, NULL, 0);
+#endif
 
 	Serial.println("\n\nBike Computer started.");
 	Serial.printf("Compile date and time: %s, %s.\n\n", __DATE__, __TIME__);
 
+	boot_profile_mark("serial");
+
+	spi_mutex = xSemaphoreCreateMutex();
+	lcd_tx_free = xSemaphoreCreateCounting(LCD_TX_BUFFERS, LCD_TX_BUFFERS);
+	spi_lcd_queue = xQueueCreate(LCD_TX_BUFFERS, sizeof(lcd_request_struct));
+	spi_sd_queue = xQueueCreate(SPI_SD_QUEUE_LENGTH, sizeof(spi_sd_request_struct));
+	spi_request_signal = xSemaphoreCreateCounting(LCD_TX_BUFFERS + SPI_SD_QUEUE_LENGTH, 0);
+
 	Rtc.Begin();
-	ht2x.begin();
+	// The 1Hz square wave drives the software clock
+	Rtc.SetSquareWavePinClockFrequency(DS3231SquareWaveClock_1Hz);
+	Rtc.SetSquareWavePin(DS3231SquareWavePin_ModeClock);
+	clock_sync_from_rtc();
+	attachInterrupt(digitalPinToInterrupt(rtc_interrupt), clock_isr, FALLING);
+	boot_profile_mark("RTC");
 	u8g2.begin();
 	u8g2.setContrast(LCD_CONTRAST);
+#ifdef ENABLE_PARKING
+	if (park_wakeup == ESP_SLEEP_WAKEUP_TIMER)
+	{ // Only check if the bike moves, the display stays off
+		park_check = 1;
+		u8g2.setPowerSave(1);
+	}
+#endif
+	ui_init();
+	boot_profile_mark("display");
+
+	// The HTU2x needs some time after power-on, so it is started in the background
+	xTaskCreatePinnedToCore(sensor_init_task, "sensor_init", 4096, NULL, 1, NULL, 0);
 
 #ifdef USE_RFID
 	mfrc522.PCD_Init();
@@ -262,7 +877,11 @@ void setup()
 #endif
 
 #ifdef ENABLE_OTA // OTA is enabled
-	if (digitalRead(button_pin) == 0)
+	if (digitalRead(button_pin) == 0
+#ifdef ENABLE_PARKING
+		&& park_wakeup != ESP_SLEEP_WAKEUP_EXT0 // Not the button press that ended the parking
+#endif
+	)
 	{										   // Check if user button is held down at startup
 		init_ota();							   // Initialize OTA
 		while (millis() - loop_timing < 30000) // Cancel when longer than 20s
@@ -273,39 +892,48 @@ void setup()
 	WiFi.mode(WIFI_OFF);
 #endif
 
-	// Start SD Logging
-	SD_present = sd.begin(SD_CHIP_SELECT, SD_SCK_MHZ(SD_SPEED));
-	if (!SD_present)
-	{
-		Serial.println("cardBegin failed!");
-		// sd.initErrorHalt();
+	// Continue the ride if this was a reset (watchdog, brownout, crash) or a wake-up from parking
+	climb_init(&climb, CLIMB_ALT_DEADBAND, CLIMB_ALT_FILTER, CLIMB_SAMPLE_SPACING, CLIMB_MIN_WINDOW);
+	motion_init(&motion, MOTION_SPEED_STOP, MOTION_SPEED_MOVE, MOTION_SPEED_HYST, MOTION_HDOP_GOOD, MOTION_HDOP_BAD, MOTION_RADIUS, MOTION_STOP_TIME,
+				MOTION_STILL_TIME, MOTION_PARK_TIME, millis());
+#ifdef ENABLE_PARKING
+	if (park_check)
+	{ // Back to sleep if the bike doesn't move within PARK_CHECK_TIME
+		motion.park_time = PARK_CHECK_TIME;
 	}
-	if (SD_present)
-	{
-		uint32_t cardSize = sd.card()->cardSize();
-		Serial.print("Card Size: ");
-		Serial.print(cardSize * float(0.000512), 0);
-		Serial.println("MB");
-
-		if (init_sd_logger())
-		{
-			Serial.println("SD logging started successfully!");
-		}
-		else
-		{
-			Serial.println("Error while starting SD logging!");
-		}
+#endif
+#ifdef ENABLE_LOG_DECIMATION
+	log_decimator_init(&log_decimator, LOG_DECIMATION_DISTANCE, LOG_DECIMATION_HEADING, LOG_DECIMATION_HEADING_DISTANCE, LOG_DECIMATION_MAX_INTERVAL);
+#endif
+	ride_resumed = load_checkpoint();
+	if (!ride_resumed)
+	{ // A finished ride or random RTC memory, nothing of it may end up in a new checkpoint
+		memset(&checkpoint, 0, sizeof(checkpoint));
 	}
+	rtc_track_restore();
+#ifdef ENABLE_GPS_AIDING
+	gps_aiding_load();
+#endif
+	boot_profile_mark("checkpoint");
+
+	battery_init(&battery, BATTERY_FILTER, BATTERY_NOMINAL_RUNTIME, BATTERY_RATE_WINDOW);
+	battery_sample();
+
+	// Draw the first screen right away
+	rtc_time();
+	gui_selector();
+
+	// From here on the SPI bus is only used through the bus task
+	xTaskCreatePinnedToCore(spi_bus_task, "spi_bus", 8192, NULL, 2, &spi_bus_task_handle, 0);
+
+	// Mounting the card and opening the log takes a while, so do it in the background
+	xTaskCreatePinnedToCore(sd_supervisor_task, "sd_supervisor", 8192, NULL, 1, &sd_supervisor_task_handle, 0);
 
 // Initialization
 #ifdef ENABLE_PREFERENCES
 	load_max_avg_values();
 #endif
 
-	read_sensors();
-	rtc_time();
-	gui_selector();
-
 	// Set initial values VERY IMPORTANT
 	mapper.path_x_array[0] = 0;
 	mapper.path_y_array[0] = 0;
@@ -316,7 +944,83 @@ void setup()
 #ifdef ENABLE_PREFERENCES
 	log_reset_times();
 #endif
+	boot_profile_mark("setup");
 	Serial.println("Setup done");
+#ifdef ENABLE_PARKING
+	if (park_wakeup != ESP_SLEEP_WAKEUP_UNDEFINED)
+	{
+		LOG_INFO(LOG_ID_PARK_WAKE, park_wakeup, millis());
+	}
+#endif
+}
+
+// Background task: starts the temperature / humidity sensor
+void sensor_init_task(void *parameter)
+{
+	// Wire locks the bus for every transaction, so the RTC can be read at the same time
+	ht2x.begin();
+	sensors_ready = 1;
+	boot_profile_mark("sensors");
+	vTaskDelete(NULL);
+}
+
+// Background task: mounts the SD card and starts (or resumes) logging
+// Afterwards it checks periodically if the card has to be remounted
+void sd_supervisor_task(void *parameter)
+{
+	bool first_mount = 1;
+	bool log_started = 0; // A log file was opened since the start, a remount continues it
+
+	while (true)
+	{
+		if (!SD_present)
+		{
+			sd_state = SD_STATE_MOUNTING;
+			sd_bus_begin();
+			bool status = sd_mount();
+			if (status)
+			{
+				// The checkpoint is kept up to date after every row, so it also describes the file before a remount
+				if ((first_mount ? ride_resumed : log_started) && resume_sd_logger())
+				{
+					LOG_INFO(LOG_ID_SD_RESUMED, log_chunk.index, log_chunk.length);
+					log_started = 1;
+				}
+				else if (init_sd_logger())
+				{ // New ride, or the file can't be continued (other card, damaged tail)
+					LOG_INFO(LOG_ID_SD_STARTED);
+					log_started = 1;
+				}
+				else
+				{
+					LOG_ERROR(LOG_ID_SD_START_FAILED);
+					status = 0;
+				}
+			}
+			if (status)
+			{
+				sd_state = SD_STATE_DRAINING;
+				status = sd_drain_backlog(); // Sets SD_present
+			}
+			if (!status)
+			{
+				file.close();
+#ifdef ENABLE_TRACK_COMPRESSION
+				track_file.close();
+#endif
+				sd_state = SD_STATE_MISSING;
+			}
+			sd_bus_end();
+		}
+
+		if (first_mount)
+		{
+			first_mount = 0;
+			sd_init_done = 1;
+			boot_profile_mark("SD");
+		}
+		vTaskDelay(pdMS_TO_TICKS(SD_PROBE_INTERVAL));
+	}
 }
 
 void loop()
@@ -324,42 +1028,83 @@ void loop()
 	// Run timed functions
 	if (millis() - loop_timing_3 >= 1000)
 	{ // Run this every 1000ms
-		on_time_helper(false);
+		// Only count here if the square wave of the RTC is missing
+		if (millis() - clock_last_edge > 2000)
+		{
+			clock_seconds++;
+			on_time_helper(false);
+		}
 		loop_timing_3 = millis();
-		// Call gui_selector(); just to update the display - not ideal here!
-		gui_selector();
 
 		if (!time_sync_flag)
 		{ // Sync RTC to GPS time
 			sync_rtc_with_gps();
 		}
+
+		if (millis() - last_battery_sample >= BATTERY_SAMPLE_INTERVAL)
+		{
+			battery_sample();
+		}
+
+#ifdef ENABLE_TELEMETRY
+		telemetry_send_profile();
+#endif
+
+		gps_diag_log();
 	}
 
 	if (millis() - loop_timing >= 500)
 	{ // Run this every 500ms
-		read_sensors();
+		// Temperature and humidity block the loop, they are read less often while the bike is parked
+		if (motion.state != MOTION_PARKED || millis() - last_sensor_read >= SENSOR_PARKED_INTERVAL)
+		{
+			read_sensors();
+			last_sensor_read = millis();
+		}
 		rtc_time();
+#ifdef ENABLE_TELEMETRY
+		telemetry_send_sensors();
+#endif
+
+		// Timeouts of the motion state (also without fixes)
+		motion_tick(&motion, millis());
+		if (motion.state != motion_logged_state)
+		{
+			motion_logged_state = motion.state;
+			LOG_INFO(LOG_ID_MOTION, motion.state, lround(motion.spread * 100));
+#ifdef ENABLE_LOG_DECIMATION
+			if (motion.state == MOTION_STOPPED)
+			{
+				LOG_INFO(LOG_ID_LOG_DECIMATION, log_decimator.kept, log_decimator.dropped);
+			}
+#endif
+		}
 
 		// Calculate average speed
 		calc_avg_speed();
 
-		if (SD_present && gps_data.speed > 0)
+		if (motion_moving(&motion))
 		{
-			digitalWrite(DISABLE_CHIP_SELECT, HIGH);
-			digitalWrite(SD_CHIP_SELECT, LOW);
-			SD_present = sd_log_data();
-			digitalWrite(SD_CHIP_SELECT, HIGH);
-			digitalWrite(DISABLE_CHIP_SELECT, LOW);
+			log_fix();
 		}
 
-		// Call gui_selector(); just to update the display
-		gui_selector();
+		if (SD_present && millis() - last_ride_index_update >= RIDE_INDEX_INTERVAL)
+		{
+			sd_submit(SPI_SD_INDEX, NULL);
+			last_ride_index_update = millis();
+		}
+
+		// Print boot timing once everything has started
+		boot_profile_print();
+
+		// Save trip state and log position
+		save_checkpoint();
 
 		loop_timing = millis();
 	}
 
-	if (millis() - loop_timing_2 >= 10)
-	{ // Run this every 10ms
+	if (millis() - loop_timing_2 >= LDR_SAMPLE_INTERVAL)
+	{ // Run this every LDR_SAMPLE_INTERVAL ms
 		// Dim Screen Backlight
 		ldr_dimmer();
 		loop_timing_2 = millis();
@@ -367,6 +1112,20 @@ void loop()
 
 	// Update GPS Data
 	update_gps();
+#ifdef ENABLE_TELEMETRY
+	loop_count++;
+#endif
+
+#ifdef ENABLE_HISTORY_DISPLAY
+	// The SPI bus task finished loading the rides
+	if (history_version != history_drawn_version)
+	{
+		screen_data_update(SCREEN_DATA_HISTORY);
+	}
+#endif
+
+	// Redraw the display if the selected screen needs it
+	gui_refresh();
 
 #ifdef ENABLE_PREFERENCES
 	// Execute code if GPS has a fix
@@ -378,47 +1137,60 @@ void loop()
 	}
 #endif
 
+#ifdef ENABLE_PARKING
+	// Deep sleep if the bike doesn't move
+	park_update();
+#endif
+
 	// Check for button press
 	if (button_data)
 	{
 		button_data = 0;
 
 		// Advance GUI
-		if (gui_selection < 2)
-		{
-			gui_selection++;
-		}
-		else
-		{
-			gui_selection = 0;
-		}
-
-// Account for the fact that some screens might be unselected in the config
-#ifndef ENABLE_TRIP_VISUALIZER
-		if (gui_selection == 1)
-			gui_selection++;
+#ifdef ENABLE_PARKING
+		if (!park_activity()) // The first press after a timer wake-up only turns the display on
 #endif
-#ifndef ENABLE_STATS_DISPLAY
-		if (gui_selection == 2)
-			gui_selection = 0;
-#endif
-
-		gui_selector();
+			gui_next_screen();
 	}
 }
 
+// Measures the battery voltage (average of BATTERY_OVERSAMPLING readings)
 float read_battery_voltage()
 {
-	int ref_val = analogRead(ref_pin);
-	float battery_voltage = (4095.0 / ref_val) * (REF_VOLTAGE / REF_ADJ);
-	// Serial.printf("Analog value: %i\nBattery Voltage: %f\n", ref_val, battery_voltage);
+	unsigned long ref_sum = 0;
+	for (int i = 0; i < BATTERY_OVERSAMPLING; i++)
+	{
+		ref_sum += analogRead(ref_pin);
+	}
+	float battery_voltage = battery_voltage_from_reference((double)ref_sum / BATTERY_OVERSAMPLING, REF_VOLTAGE / REF_ADJ);
 	return battery_voltage;
 }
 
+// Updates the filtered voltage and runtime estimation in battery
+// The display and the logger only use these cached values
+void battery_sample()
+{
+	battery_update(&battery, read_battery_voltage(), millis());
+	last_battery_sample = millis();
+}
+
 void read_sensors()
 {
+	// Sensor is still starting (see sensor_init_task())
+	if (!sensors_ready)
+	{
+		return;
+	}
+
+	float last_temp = temp, last_humid = humid;
 	humid = ht2x.readHumidity();
 	temp = ht2x.readTemperature();
+	sensors_read = 1;
+	if (lroundf(temp) != lroundf(last_temp) || lroundf(humid) != lroundf(last_humid))
+	{ // Shown rounded on the statistics screen
+		screen_data_update(SCREEN_DATA_STATS);
+	}
 
 	/*Serial.print(" Temperature:");
 	Serial.print(temp, 1);
@@ -437,14 +1209,20 @@ void read_sensors()
 		decimal_places = 0;
 	}
 
-	sensor_comb = String(temp, decimal_places) + "C " + String(humid, 0) + "%";
+	char text[24];
+	fixed_writer_struct w;
+	fixed_writer_init(&w, text, sizeof(text));
+	fixed_append_double(&w, temp, decimal_places, 0, 0);
+	fixed_append_text(&w, "C ");
+	fixed_append_double(&w, humid, 0, 0, 0);
+	fixed_append_char(&w, '%');
+	sensor_comb = text;
 }
 
 void rtc_time()
 {
-	// RTC Measurement
-
-	RtcDateTime now = Rtc.GetDateTime();
+	// Software clock, no I2C access
+	RtcDateTime now = clock_now();
 
 	String day_padding = zero_padder(String(now.Day())); // Add Padding to Days
 	/*Serial.print(day_padding);
@@ -499,40 +1277,420 @@ String zero_padder(String z_p)
 }
 
 // Dim the backlight according to the LDR reading and apply a low pass filter
+// Called every LDR_SAMPLE_INTERVAL ms, the transition itself is done by the LEDC fade engine
 void ldr_dimmer()
 {
-	static int prev_state = 0;
-	ldr_reading = analogRead(ldr_pin);
+	static bool startup = 0;
+	static bool dark = 0;
+	int reading = analogRead(ldr_pin);
+
+	if (!startup)
+	{ // Called once at startup
+		startup = 1;
+		ldr_reading = reading;
+		dark = ldr_reading <= LDR_DARK_VAL;
+	}
+	else
+	{
+		ldr_reading = ldr_reading + (reading - ldr_reading) / LDR_FILTER_DIVIDER;
+	}
 
-	if (ldr_reading <= LDR_DARK_VAL /*&& prev_state == 0 || ldr_reading < LDR_DARK_VAL - LDR_HYSTERESIS*/)
+	// Hysteresis: dark below LDR_DARK_VAL, bright above LDR_DARK_VAL + LDR_HYSTERESIS
+	if (!dark && ldr_reading <= LDR_DARK_VAL)
 	{ // Very dark
-		pwm_value = DARK_PWM_VAL;
-		prev_state = 0;
+		dark = 1;
 	}
-	else if (ldr_reading > LDR_DARK_VAL && prev_state == 1 || ldr_reading > LDR_DARK_VAL + LDR_HYSTERESIS)
+	else if (dark && ldr_reading > LDR_DARK_VAL + LDR_HYSTERESIS)
 	{
-		pwm_value = 0;
-		prev_state = 1;
+		dark = 0;
 	}
 
-	ledcWrite(ledChannel, pwm_value);
+	int target = dark ? DARK_PWM_VAL : 0;
+#ifdef ENABLE_PARKING
+	if (park_check)
+	{ // Display is off
+		target = 0;
+	}
+#endif
+	if (target != pwm_value)
+	{
+		pwm_value = target;
+		ledc_set_fade_with_time(LEDC_HIGH_SPEED_MODE, (ledc_channel_t)ledChannel, pwm_value, LDR_FADE_TIME);
+		ledc_fade_start(LEDC_HIGH_SPEED_MODE, (ledc_channel_t)ledChannel, LEDC_FADE_NO_WAIT);
+	}
 }
 
-/*IRAM_ATTR*/
-void IRAM_ATTR button_isr()
+// Saves the time of a boot stage (called from setup() and the startup tasks)
+void boot_profile_mark(const char *stage)
 {
-	if (millis() - button_timing >= 300)
+	unsigned long now = micros();
+	portENTER_CRITICAL(&mux);
+	if (boot_profile.count < BOOT_PROFILE_STAGES)
 	{
-		button_timing = millis();
-		button_data = 1;
+		boot_profile.stage[boot_profile.count] = stage;
+		boot_profile.time[boot_profile.count] = now;
+		boot_profile.count++;
 	}
+	portEXIT_CRITICAL(&mux);
 }
 
-#ifdef USE_RFID
-void rfid_lockscreen()
+void boot_profile_print()
 {
-	bool rfid_lock = 1;
-	while (rfid_lock)
+#ifdef DEBUG
+	// Wait for setup(), both startup tasks and the first speed display
+	if (boot_profile.printed || !sensors_ready || !sd_init_done || !first_speed_display)
+	{
+		return;
+	}
+	boot_profile.printed = 1;
+
+	Serial.println("Boot timing:");
+	unsigned long previous = 0;
+	for (byte i = 0; i < boot_profile.count; i++)
+	{
+		Serial.printf("%-20s %7.1lfms (+%.1lfms)\n", boot_profile.stage[i], boot_profile.time[i] / 1000.0, (boot_profile.time[i] - previous) / 1000.0);
+		previous = boot_profile.time[i];
+	}
+#endif // DEBUG
+}
+
+// Gives the SPI bus to the SD card
+// Only the SPI bus task and the SD supervisor may call this, everything else queues an SD request (see sd_submit())
+void sd_bus_begin()
+{
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+	configASSERT(task == spi_bus_task_handle || task == sd_supervisor_task_handle);
+	xSemaphoreTake(spi_mutex, portMAX_DELAY);
+	digitalWrite(DISABLE_CHIP_SELECT, HIGH);
+	digitalWrite(SD_CHIP_SELECT, LOW);
+}
+
+// Gives the SPI bus back to the LCD
+void sd_bus_end()
+{
+	digitalWrite(SD_CHIP_SELECT, HIGH);
+	digitalWrite(DISABLE_CHIP_SELECT, LOW);
+	xSemaphoreGive(spi_mutex);
+}
+
+// Executes the queued LCD and SD transfers
+void spi_bus_task(void *parameter)
+{
+	lcd_request_struct frame;
+	spi_sd_request_struct request;
+	int stride = u8g2.getBufferTileWidth() * 8;
+
+	while (true)
+	{
+		xSemaphoreTake(spi_request_signal, portMAX_DELAY);
+
+		// LCD first
+		if (xQueueReceive(spi_lcd_queue, &frame, 0) == pdTRUE)
+		{
+			unsigned long send_start = micros();
+			xSemaphoreTake(spi_mutex, portMAX_DELAY);
+			for (byte page = 0; page < u8g2.getBufferTileHeight(); page++)
+			{
+				if (frame.pages & (1 << page))
+					u8x8_DrawTile(u8g2.getU8x8(), 0, page, u8g2.getBufferTileWidth(), lcd_tx_buffer[frame.buffer] + page * stride);
+			}
+			xSemaphoreGive(spi_mutex);
+			xSemaphoreGive(lcd_tx_free);
+
+			lcd_timing.send_us += micros() - send_start;
+			lcd_timing.frames++;
+			if (frame.input_us)
+			{
+				lcd_timing.latency_us = micros() - frame.input_us;
+				if (lcd_timing.latency_us > lcd_timing.latency_max_us)
+					lcd_timing.latency_max_us = lcd_timing.latency_us;
+				LOG_INFO(LOG_ID_BUTTON_LATENCY, lcd_timing.latency_us, lcd_timing.latency_max_us);
+			}
+			if (lcd_timing.frames >= UI_TIMING_FRAMES)
+			{
+				LOG_DEBUG(LOG_ID_LCD_TIMING, lcd_timing.send_us / lcd_timing.frames);
+				lcd_timing.send_us = 0;
+				lcd_timing.frames = 0;
+			}
+			continue;
+		}
+
+		if (xQueueReceive(spi_sd_queue, &request, 0) != pdTRUE)
+		{
+			continue;
+		}
+		if (request.type == SPI_SD_ROW)
+		{
+			// The SD supervisor sets SD_present only once the backlog is empty (see sd_drain_backlog())
+			portENTER_CRITICAL(&backlog_mux);
+			bool buffered = !SD_present;
+			if (buffered)
+			{
+				backlog_push(&request.record);
+			}
+			portEXIT_CRITICAL(&backlog_mux);
+
+			if (!buffered)
+			{
+				sd_bus_begin();
+				bool status = sd_log_data(&request.record);
+				sd_bus_end();
+
+				if (status)
+				{
+					sd_row_persisted(&request.record);
+				}
+				else
+				{ // Keep the row, the supervisor will remount the card
+					portENTER_CRITICAL(&backlog_mux);
+					SD_present = 0;
+					sd_state = SD_STATE_MISSING;
+					backlog_push(&request.record);
+					portEXIT_CRITICAL(&backlog_mux);
+				}
+			}
+		}
+		else if (request.type == SPI_SD_INDEX || request.type == SPI_SD_PARK)
+		{
+			if (SD_present)
+			{
+				sd_bus_begin();
+				sd_write_chunk_header();
+				file.flush();
+#ifdef ENABLE_TRACK_COMPRESSION
+				// The partial block, so at most one index interval of the track is lost
+				track_write_block();
+				track_file.flush();
+#endif
+				update_ride_index();
+				sd_bus_end();
+				save_log_position();
+			}
+#ifdef ENABLE_PARKING
+			if (request.type == SPI_SD_PARK)
+			{ // Keep the bus until the deep sleep, the SD supervisor must not start a mount now
+				xSemaphoreTake(spi_mutex, portMAX_DELAY);
+				u8g2.setPowerSave(1);
+				xSemaphoreGive(park_ready);
+				vTaskSuspend(NULL);
+			}
+#endif
+		}
+#ifdef ENABLE_HISTORY_DISPLAY
+		else if (request.type == SPI_SD_HISTORY)
+		{
+			ride_index_entry_struct entries[HISTORY_RIDES];
+			byte count = 0;
+			bool present = SD_present;
+			if (present)
+			{
+				sd_bus_begin();
+				update_ride_index();
+				count = load_ride_history(entries);
+				sd_bus_end();
+			}
+
+			// The loop draws from history[], swap the new rides in at once
+			portENTER_CRITICAL(&history_mux);
+			memcpy(history, entries, count * sizeof(ride_index_entry_struct));
+			history_count = count;
+			history_state = present ? HISTORY_READY : HISTORY_NO_CARD;
+			portEXIT_CRITICAL(&history_mux);
+			history_version++;
+		}
+#endif
+	}
+}
+
+// Queues the pages (bit mask) of the frame buffer for sending
+// If all front buffers are still being sent, the pages are sent with the next call
+void lcd_submit(byte pages)
+{
+	pages |= lcd_pending_pages;
+	if (!pages)
+	{
+		return;
+	}
+	if (xSemaphoreTake(lcd_tx_free, 0) != pdTRUE)
+	{
+		lcd_pending_pages = pages;
+		return;
+	}
+	lcd_pending_pages = 0;
+
+	lcd_request_struct frame;
+	frame.pages = pages;
+	frame.buffer = lcd_tx_next;
+	frame.input_us = lcd_input_us;
+	lcd_input_us = 0;
+	lcd_tx_next = (lcd_tx_next + 1) % LCD_TX_BUFFERS;
+
+	int stride = u8g2.getBufferTileWidth() * 8;
+	for (byte page = 0; page < u8g2.getBufferTileHeight(); page++)
+	{
+		if (pages & (1 << page))
+			memcpy(lcd_tx_buffer[frame.buffer] + page * stride, u8g2.getBufferPtr() + page * stride, stride);
+	}
+	xQueueSend(spi_lcd_queue, &frame, portMAX_DELAY);
+	xSemaphoreGive(spi_request_signal);
+}
+
+// Prints the deferred debug log (low priority)
+void debug_log_task(void *parameter)
+{
+	const char levels[] = "?EWID";
+	debug_log_event_struct event;
+
+	while (true)
+	{
+		while (debug_log_pop(&debug_log, &event))
+		{
+#ifdef ENABLE_TELEMETRY
+			telemetry_log_struct record;
+			record.time_ms = event.time_ms;
+			record.id = event.id;
+			record.level = event.level;
+			memcpy(record.args, event.args, sizeof(record.args));
+			telemetry_send(TELEMETRY_LOG, &record, sizeof(record));
+			continue;
+#endif
+			Serial.printf("%8lu %c ", (unsigned long)event.time_ms, levels[event.level < sizeof(levels) - 1 ? event.level : 0]);
+			if (event.id < LOG_ID_COUNT)
+			{
+				Serial.printf(debug_log_formats[event.id], (long)event.args[0], (long)event.args[1], (long)event.args[2], (long)event.args[3]);
+			}
+			Serial.println();
+		}
+
+#ifndef ENABLE_TELEMETRY // Sent with the profile counters
+		uint32_t dropped = debug_log_take_dropped(&debug_log);
+		if (dropped)
+		{
+			Serial.printf("(%u log messages dropped)\n", dropped);
+		}
+#endif
+		vTaskDelay(pdMS_TO_TICKS(DEBUG_LOG_INTERVAL));
+	}
+}
+
+#ifdef ENABLE_TELEMETRY
+// Sends a frame if it fits into the TX buffer, the loop never waits for the serial port
+void telemetry_send(uint8_t type, const void *payload, size_t length)
+{
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	size_t frame_length = telemetry_frame(type, payload, length, frame);
+
+	if (frame_length == 0 || Serial.availableForWrite() < (int)frame_length)
+	{
+		portENTER_CRITICAL(&telemetry_mux);
+		telemetry_dropped++;
+		portEXIT_CRITICAL(&telemetry_mux);
+		return;
+	}
+	Serial.write(frame, frame_length);
+}
+
+void telemetry_send_fix()
+{
+	telemetry_fix_struct fix;
+	fix.time_ms = millis();
+	fix.lat = gps.location.lat();
+	fix.lng = gps.location.lng();
+	fix.speed = gps_data.speed;
+	fix.altitude = gps_data.altitude;
+	fix.course = gps_data.course;
+	fix.distance_km = gps_data.travel_distance_km;
+	fix.grade = climb.grade;
+	fix.satellites = gps_data.satellites;
+	telemetry_send(TELEMETRY_FIX, &fix, sizeof(fix));
+}
+
+void telemetry_send_sensors()
+{
+	telemetry_sensor_struct sensor;
+	sensor.time_ms = millis();
+	sensor.temperature = temp;
+	sensor.humidity = humid;
+	sensor.light = ldr_reading;
+	sensor.backlight = pwm_value;
+	sensor.battery_voltage = battery.voltage;
+	sensor.battery_soc = battery.soc;
+	sensor.battery_runtime_h = battery.runtime_h;
+	telemetry_send(TELEMETRY_SENSOR, &sensor, sizeof(sensor));
+}
+
+void telemetry_send_profile()
+{
+	telemetry_profile_struct profile;
+	profile.time_ms = millis();
+	profile.loops = loop_count;
+	loop_count = 0;
+	profile.ui_compose_us = ui_timing.frames ? ui_timing.compose_us / ui_timing.frames : 0;
+	profile.ui_queue_us = ui_timing.frames ? ui_timing.send_us / ui_timing.frames : 0;
+	profile.lcd_send_us = lcd_timing.frames ? lcd_timing.send_us / lcd_timing.frames : 0;
+	profile.free_heap = ESP.getFreeHeap();
+	profile.backlog_rows = backlog_rows;
+	profile.sd_state = sd_state;
+	profile.screen = gui_selection;
+	profile.log_dropped = debug_log_take_dropped(&debug_log);
+	portENTER_CRITICAL(&telemetry_mux);
+	profile.telemetry_dropped = telemetry_dropped;
+	portEXIT_CRITICAL(&telemetry_mux);
+	profile.gps_chars = gps.charsProcessed();
+	profile.gps_failed_checksum = gps.failedChecksum();
+	telemetry_send(TELEMETRY_PROFILE, &profile, sizeof(profile));
+}
+#endif // ENABLE_TELEMETRY
+
+// Queues an SD request, waits if the card is slower than the queue
+void sd_submit(byte type, const log_record_struct *record)
+{
+	spi_sd_request_struct request;
+	request.type = type;
+	if (record)
+	{
+		memcpy(&request.record, record, LOG_RECORD_HEADER_SIZE + record->length);
+	}
+	xQueueSend(spi_sd_queue, &request, portMAX_DELAY);
+	xSemaphoreGive(spi_request_signal);
+}
+
+// Falling edge of the 1Hz square wave of the DS3231
+void IRAM_ATTR clock_isr()
+{
+	clock_seconds++;
+	seconds_running++; // On-time
+	clock_last_edge = millis();
+}
+
+// Reads the time from the RTC (I2C)
+void clock_sync_from_rtc()
+{
+	clock_seconds = Rtc.GetDateTime().TotalSeconds();
+}
+
+// Current time of the software clock
+RtcDateTime clock_now()
+{
+	return RtcDateTime(clock_seconds);
+}
+
+/*IRAM_ATTR*/
+void IRAM_ATTR button_isr()
+{
+	if (millis() - button_timing >= 300)
+	{
+		button_timing = millis();
+		button_press_us = micros();
+		button_data = 1;
+	}
+}
+
+#ifdef USE_RFID
+void rfid_lockscreen()
+{
+	bool rfid_lock = 1;
+	while (rfid_lock)
 	{
 		// Run timed functions in locked mode
 		if (millis() - loop_timing >= 1000)
@@ -563,8 +1721,8 @@ void rfid_lockscreen()
 			u8g2.drawHLine(81, 27, 47);
 			loop_timing = millis();
 		}
-		if (millis() - loop_timing_2 >= 10)
-		{ // Run this every 10ms
+		if (millis() - loop_timing_2 >= LDR_SAMPLE_INTERVAL)
+		{ // Run this every LDR_SAMPLE_INTERVAL ms
 			// Dim Screen Backlight
 			ldr_dimmer();
 			loop_timing_2 = millis();
@@ -623,8 +1781,10 @@ void sync_rtc_with_gps()
 {
 	if (gps.time.isValid() && gps.date.isValid() && gps.time.isUpdated() && gps.date.isUpdated() && gps.satellites.value() > 3 && gps.time.hour() != 24)
 	{
-		Rtc.SetDateTime(RtcDateTime(gps.date.year(), gps.date.month(), gps.date.day(), gps.time.hour() + UTC_ADJ, gps.time.minute(), gps.time.second()));
-		Serial.println("Time synced");
+		RtcDateTime gps_time(gps.date.year(), gps.date.month(), gps.date.day(), gps.time.hour() + UTC_ADJ, gps.time.minute(), gps.time.second());
+		Rtc.SetDateTime(gps_time);
+		clock_seconds = gps_time.TotalSeconds();
+		LOG_INFO(LOG_ID_TIME_SYNCED);
 		time_sync_flag = 1;
 	}
 }
@@ -656,8 +1816,8 @@ void gps_mapper()
 	int size_of_path_array = sizeof(mapper.path_x_array) / sizeof(double);
 
 	// Calculate new values for current dataset
-	mapper.current_length = gps.distanceBetween(mapper.last_lat, mapper.last_lng, gps.location.lat(), gps.location.lng());
-	mapper.current_heading = gps.courseTo(mapper.last_lat, mapper.last_lng, gps.location.lat(), gps.location.lng());
+	mapper.current_length = geo_haversine_m(mapper.last_lat, mapper.last_lng, gps.location.lat(), gps.location.lng());
+	mapper.current_heading = geo_bearing_deg(mapper.last_lat, mapper.last_lng, gps.location.lat(), gps.location.lng());
 
 	// Convert angle
 	mapper.current_heading = mapper.current_heading * PI / 180;
@@ -705,6 +1865,8 @@ void gps_mapper()
 			Serial.print("mapper.path_counter: ");		Serial.println(mapper.path_counter);*/
 #endif
 
+			screen_data_update(SCREEN_DATA_PATH);
+
 			// Increment variable / reset it in case of an overflow
 			mapper.path_counter += 1;
 			if (mapper.path_counter == (sizeof(mapper.path_x_array) / 8) - 1)
@@ -826,32 +1988,15 @@ void draw_gps_path()
 		if (mapper.ten_meter_x_array[i + 1] != 0 && mapper.ten_meter_y_array[i + 1] != 0)
 			u8g2.drawLine(x_coord_start, y_coord_start, x_coord_end, y_coord_end);
 
-		Serial.print("x_coord_start: ");
-		Serial.println(x_coord_start);
-		Serial.print("x_coord_end: ");
-		Serial.println(x_coord_end);
-		Serial.print("y_coord_start: ");
-		Serial.println(y_coord_start);
-		Serial.print("y_coord_end: ");
-		Serial.println(y_coord_end);
+		LOG_DEBUG(LOG_ID_PATH_LINE, x_coord_start, y_coord_start, x_coord_end, y_coord_end);
 	}
 
 	// Debug output
 	/*
 	Serial.print(": ");		Serial.println();
 	*/
-	Serial.print("x_max: ");
-	Serial.println(x_max);
-	Serial.print("x_min: ");
-	Serial.println(x_min);
-	Serial.print("y_max: ");
-	Serial.println(y_max);
-	Serial.print("y_min: ");
-	Serial.println(y_min);
-	Serial.print("x_span: ");
-	Serial.println(x_span);
-	Serial.print("y_span: ");
-	Serial.println(y_span);
+	LOG_DEBUG(LOG_ID_PATH_BOUNDS, lround(x_min * 100), lround(x_max * 100), lround(y_min * 100), lround(y_max * 100));
+	LOG_DEBUG(LOG_ID_PATH_SPAN, lround(x_span * 100), lround(y_span * 100));
 #else
 	/*
 	Test Data
@@ -1034,7 +2179,7 @@ void draw_gps_path()
 
 	u8g2.drawVLine((u8g2.getDisplayWidth() / 2) - 3, 0, u8g2.getDisplayHeight());
 
-	u8g2.sendBuffer();
+	lcd_submit(LCD_ALL_PAGES);
 }
 #endif
 
@@ -1043,6 +2188,9 @@ void measure_distance_gps()
 	// Check if location has changed
 	if (gps.location.isUpdated())
 	{
+		double hdop = gps.hdop.isValid() ? gps.hdop.hdop() : 99.99;
+		motion_update(&motion, millis(), gps.location.lat(), gps.location.lng(), gps.speed.kmph(), hdop);
+
 		if (!gps_data.startup)
 		{ // Called once at startup
 			gps_data.startup = 1;
@@ -1053,10 +2201,10 @@ void measure_distance_gps()
 			mapper.last_lat = gps.location.lat();
 			mapper.last_lng = gps.location.lng();
 		}
-		else
-		{
+		else if (motion_moving(&motion))
+		{ // While the bike stands the last position is kept, so the jitter doesn't add up
 			// gps_data.travel_distance;
-			gps_data.travel_distance_km = gps_data.travel_distance_km + (gps.distanceBetween(gps.location.lat(), gps.location.lng(), gps_data.last_lat, gps_data.last_lng) / 1000.0);
+			gps_data.travel_distance_km = gps_data.travel_distance_km + (geo_haversine_m(gps.location.lat(), gps.location.lng(), gps_data.last_lat, gps_data.last_lng) / 1000.0);
 
 			gps_data.last_lat = gps.location.lat();
 			gps_data.last_lng = gps.location.lng();
@@ -1071,12 +2219,22 @@ void measure_distance_gps()
 			gps_mapper();
 #endif
 		}
+
+		// Update ascent, descent and grade
+		if (gps.altitude.isValid() && motion_moving(&motion))
+		{
+			double ascent = climb.total_ascent;
+			climb_update(&climb, gps_data.travel_distance_km * 1000.0, gps.altitude.meters());
+			if (climb.total_ascent != ascent)
+				screen_data_update(SCREEN_DATA_STATS);
+		}
 	}
 }
 
 void update_gps_data()
 {
-	if (gps.speed.age() < 1000)
+	// The speed is 0 while the bike stands, whatever the GPS says
+	if (gps.speed.age() < 1000 && motion_moving(&motion))
 	{
 		// Display "0" as speed if it's lower than the threshold
 		if (gps.speed.kmph() < GPS_SPEED_DISPLAY_THRESH)
@@ -1086,6 +2244,11 @@ void update_gps_data()
 		else
 		{
 			gps_data.speed = gps.speed.kmph();
+			if (gps_data.speed > stats.ride_max_speed)
+			{
+				stats.ride_max_speed = gps_data.speed;
+				screen_data_update(SCREEN_DATA_STATS);
+			}
 		}
 	}
 	else
@@ -1123,11 +2286,16 @@ void update_gps_data()
 
 void update_gps()
 {
+	int buffered = Serial2.available();
+	if (buffered > gps_diag.max_buffered)
+	{
+		gps_diag.max_buffered = buffered;
+	}
+
 	while (Serial2.available() > 0)
 	{
 		if (gps.encode(Serial2.read()))
 		{
-			// display_gps_info();
 			if (millis() > 5000 && gps.charsProcessed() < 10)
 			{
 				Serial.println(F("No GPS detected: check wiring."));
@@ -1137,89 +2305,176 @@ void update_gps()
 		}
 	}
 
+#ifdef ENABLE_GPS_AIDING
+	// The receiver accepts the aiding data once it is up, which it shows by sending
+	if (!gps_aiding_done && gps.charsProcessed() > 0)
+	{
+		gps_aiding_send();
+	}
+#endif
+
 	// Update GPS Data struct
 	update_gps_data();
 
+	bool fix_updated = gps.location.isUpdated();
+
 	// Calculate Distance
 	measure_distance_gps();
+
+	if (fix_updated)
+	{
+		gps_fix_update();
+#ifdef ENABLE_TELEMETRY
+		telemetry_send_fix();
+#endif
+	}
 }
 
-void calc_avg_speed()
+// Called by the UART event task
+void gps_uart_error(hardwareSerial_error_t error)
 {
-	static unsigned long last_call_time = 0;
-	static unsigned long total_valid_time = 0.1; // Time where speed was > 0; can't be 0 because of division
-	unsigned long delta_time = 0;
-
-	// Only calculate average, if speed was greater than zero
-	if (gps_data.speed > 0.0)
+	switch (error)
 	{
-		delta_time = millis() - last_call_time;
-		last_call_time = millis();
-
-		stats.avg_speed = (gps_data.travel_distance_km / total_valid_time) * 1000 * 3600; // km per ms -> km/h
+	case UART_FIFO_OVF_ERROR:
+		gps_diag.fifo_overflows++;
+		break;
+	case UART_BUFFER_FULL_ERROR:
+		gps_diag.buffer_overflows++;
+		break;
+	case UART_FRAME_ERROR:
+	case UART_PARITY_ERROR:
+	case UART_BREAK_ERROR:
+		gps_diag.framing_errors++;
+		break;
+	default:
+		break;
+	}
+}
 
-		total_valid_time += delta_time;
+// Logs the receive statistics every GPS_DIAG_INTERVAL ms, lost data right away
+void gps_diag_log()
+{
+	uint32_t lost = gps_diag.fifo_overflows + gps_diag.buffer_overflows + gps_diag.framing_errors;
+	if (lost != gps_diag.logged_lost)
+	{
+		gps_diag.logged_lost = lost;
+		LOG_WARN(LOG_ID_GPS_RX_LOST, gps_diag.fifo_overflows, gps_diag.buffer_overflows, gps_diag.framing_errors);
 	}
-	else
+	if (millis() - gps_diag.last_log >= GPS_DIAG_INTERVAL)
 	{
-		last_call_time = millis();
+		gps_diag.last_log = millis();
+		LOG_INFO(LOG_ID_GPS_RX, gps.passedChecksum(), gps.failedChecksum(), gps_diag.max_buffered);
 	}
 }
 
-void display_gps_info()
+void gps_fix_update()
 {
-	Serial.print(F("Location: "));
-	if (gps.location.isValid())
+	if (!check_gps_fix())
 	{
-		Serial.print(gps.location.lat(), 6);
-		Serial.print(F(","));
-		Serial.print(gps.location.lng(), 6);
+		return;
 	}
-	else
+	if (gps_ttff == 0)
 	{
-		Serial.print(F("INVALID"));
+		gps_ttff = millis();
+		LOG_INFO(LOG_ID_GPS_TTFF, gps_ttff, gps_aiding_sent);
 	}
 
-	Serial.print(F("  Date/Time: "));
-	if (gps.date.isValid())
+#ifdef ENABLE_GPS_AIDING
+	// Only good fixes with a valid date are saved for the next start
+	if (gps.hdop.isValid() && gps.hdop.hdop() <= GPS_AIDING_MAX_HDOP && gps.date.isValid() && gps.time.isValid() && gps.date.year() >= 2000)
 	{
-		Serial.print(gps.date.month());
-		Serial.print(F("/"));
-		Serial.print(gps.date.day());
-		Serial.print(F("/"));
-		Serial.print(gps.date.year());
+		RtcDateTime utc(gps.date.year(), gps.date.month(), gps.date.day(), gps.time.hour(), gps.time.minute(), gps.time.second());
+		// The altitude is above sea level instead of the ellipsoid, the position margin covers that
+		gps_aiding_set(&gps_aiding, gps.location.lat(), gps.location.lng(), gps.altitude.meters(), utc.TotalSeconds(), gps.hdop.hdop(), gps.satellites.value());
+#ifdef ENABLE_PREFERENCES
+		if (gps_aiding_saved == 0 || millis() - gps_aiding_saved >= GPS_AIDING_SAVE_INTERVAL)
+		{
+			gps_aiding_store();
+		}
+#endif
 	}
-	else
+#endif
+}
+
+#ifdef ENABLE_GPS_AIDING
+// The saved fix survives resets and deep sleep in RTC memory, after a power cycle it is read from the flash
+void gps_aiding_load()
+{
+	if (gps_aiding_valid(&gps_aiding))
+	{
+		return;
+	}
+#ifdef ENABLE_PREFERENCES
+	preferences.begin("gps_aiding", true);
+	preferences.getBytes("fix", &gps_aiding, sizeof(gps_aiding));
+	preferences.end();
+#endif
+}
+
+// Sends the saved fix and the time of the DS3231 to the receiver (only once)
+void gps_aiding_send()
+{
+	gps_aiding_done = 1;
+
+	// The software clock (local time) was advanced at the last square wave edge
+	unsigned long edge;
+	uint32_t seconds;
+	do
+	{
+		edge = clock_last_edge;
+		seconds = clock_seconds;
+	} while (edge != clock_last_edge);
+	unsigned long since_edge = millis() - edge;
+	// A clock before the saved fix (e.g. the DS3231 lost its time) is ignored by gps_aiding_frames()
+	uint32_t now = seconds >= UTC_ADJ * 3600 ? seconds - UTC_ADJ * 3600 : 0;
+
+	uint8_t frames[GPS_AIDING_MAX_FRAMES_SIZE];
+	size_t length = gps_aiding_frames(&gps_aiding, now, edge != 0 && since_edge < 1000 ? since_edge : 0, GPS_AIDING_POS_MARGIN, frames, sizeof(frames));
+	if (length > 0)
 	{
-		Serial.print(F("INVALID"));
+		Serial2.write(frames, length);
+		gps_aiding_sent = length > UBX_OVERHEAD + sizeof(ubx_mga_ini_pos_llh_struct) ? 2 : 1;
+		LOG_INFO(LOG_ID_GPS_AIDING, length, gps_aiding_sent > 1);
 	}
+}
+
+#ifdef ENABLE_PREFERENCES
+// Writes the saved fix to the flash, so it is also there after a power cycle
+void gps_aiding_store()
+{
+	gps_aiding_saved = millis();
+	preferences.begin("gps_aiding", false);
+	preferences.putBytes("fix", &gps_aiding, sizeof(gps_aiding));
+	preferences.end();
+}
+#endif
+#endif
+
+void calc_avg_speed()
+{
+	static unsigned long last_call_time = 0;
+	unsigned long delta_time = 0;
 
-	Serial.print(F(" "));
-	if (gps.time.isValid())
+	// Only calculate average while moving (auto-pause)
+	if (motion_moving(&motion))
 	{
-		if (gps.time.hour() < 10)
-			Serial.print(F("0"));
-		Serial.print(gps.time.hour());
-		Serial.print(F(":"));
-		if (gps.time.minute() < 10)
-			Serial.print(F("0"));
-		Serial.print(gps.time.minute());
-		Serial.print(F(":"));
-		if (gps.time.second() < 10)
-			Serial.print(F("0"));
-		Serial.print(gps.time.second());
-		Serial.print(F("."));
-		if (gps.time.centisecond() < 10)
-			Serial.print(F("0"));
-		Serial.print(gps.time.centisecond());
+		delta_time = millis() - last_call_time;
+		last_call_time = millis();
+
+		// stats.moving_time is the time spent moving (kept across resets)
+		if (stats.moving_time > 0)
+		{
+			stats.avg_speed = (gps_data.travel_distance_km / stats.moving_time) * 1000 * 3600; // km per ms -> km/h
+		}
+
+		stats.moving_time += delta_time;
 	}
 	else
 	{
-		Serial.print(F("INVALID"));
+		last_call_time = millis();
 	}
-
-	Serial.println();
 }
+
 // END GPS
 /////////////////////////////////////////////////////////////////////////
 
@@ -1230,24 +2485,82 @@ All Display related code goes here
 */
 
 // This function calls the apppropriate GUI drawing function
-void gui_selector()
+/*
+Screen registry
+gui_selection is the index of the selected screen.
+*/
+screen_struct screens[] = {
+	{"main", update_display, NULL, SCREEN_REFRESH_PERIODIC, SCREEN_MAIN_INTERVAL, 0},
+#ifdef ENABLE_TRIP_VISUALIZER
+	{"path", draw_gps_path, NULL, SCREEN_REFRESH_ON_CHANGE, SCREEN_PATH_INTERVAL, SCREEN_DATA_PATH},
+#endif
+#ifdef ENABLE_STATS_DISPLAY
+	{"stats", draw_stats, NULL, SCREEN_REFRESH_ON_CHANGE, SCREEN_STATS_INTERVAL, SCREEN_DATA_STATS},
+#endif
+#ifdef ENABLE_HISTORY_DISPLAY
+	{"history", draw_history, enter_history, SCREEN_REFRESH_ON_CHANGE, 0, SCREEN_DATA_HISTORY},
+#endif
+#ifdef ENABLE_GPS_DIAG_DISPLAY
+	{"gps", draw_gps_diag, NULL, SCREEN_REFRESH_PERIODIC, SCREEN_DIAG_INTERVAL, 0},
+#endif
+};
+const byte screen_count = sizeof(screens) / sizeof(screen_struct);
+
+void gui_refresh()
 {
-	if (gui_selection == 0)
+	const screen_struct *screen = &screens[gui_selection];
+
+	// Pages that were drawn while the bus was busy
+	lcd_submit(0);
+
+	unsigned int interval = screen->refresh_interval;
+	if (screen->refresh == SCREEN_REFRESH_PERIODIC && !motion_moving(&motion) && interval < SCREEN_STOPPED_INTERVAL)
+	{ // Nothing but the clock changes
+		interval = SCREEN_STOPPED_INTERVAL;
+	}
+	if (screen->refresh == SCREEN_REFRESH_ON_ENTER || millis() - last_screen_draw < interval)
 	{
-		update_display();
+		return;
 	}
-#ifdef ENABLE_TRIP_VISUALIZER
-	else if (gui_selection == 1)
+	if (screen->refresh == SCREEN_REFRESH_ON_CHANGE && !(screen_data_changed & screen->depends))
 	{
-		draw_gps_path();
+		return;
 	}
-#endif
-#ifdef ENABLE_STATS_DISPLAY
-	else if (gui_selection == 2)
+	gui_selector();
+}
+
+void gui_next_screen()
+{
+	gui_selection = (gui_selection + 1) % screen_count;
+	LOG_DEBUG(LOG_ID_SCREEN, gui_selection);
+
+	// The main screen keeps its buffer between frames, every other screen overwrites it
+	ui_valid = 0;
+	lcd_input_us = button_press_us;
+	if (screens[gui_selection].enter)
 	{
-		draw_stats();
+		screens[gui_selection].enter();
 	}
-#endif
+	gui_selector();
+}
+
+// Marks data as changed, screens that depend on it are redrawn
+void screen_data_update(uint16_t data)
+{
+	screen_data_changed |= data;
+}
+
+void gui_selector()
+{
+	// Drawing only changes the buffer, it is sent by the SPI bus task
+	screens[gui_selection].draw();
+	if (gui_selection == 0 && !first_speed_display)
+	{
+		first_speed_display = 1;
+		boot_profile_mark("first speed display");
+	}
+	screen_data_changed = 0;
+	last_screen_draw = millis();
 }
 
 #ifdef ENABLE_STATS_DISPLAY
@@ -1263,116 +2576,188 @@ void draw_stats()
 	// Data
 	u8g2.setFont(u8g2_font_profont12_tf);
 	u8g2.setCursor(0, 22);
-	u8g2.print("Total Dist.:");
-	u8g2.setCursor(75, 22);
-	u8g2.printf("%.1lfkm", stats.total_dist);
+	lcd_print_fixed("Dist.:", stats.total_dist, 1, 0, "km");
+	u8g2.setCursor(87, 22);
+	lcd_print_fixed("^", climb.total_ascent, 0, 0, "m");
 	u8g2.setCursor(21, 32);
 	u8g2.print("Maximum values:");
 	u8g2.drawLine(18, 33, 110, 33);
 	u8g2.setFont(u8g2_font_profont11_tf);
 	u8g2.setCursor(0, 42);
-	u8g2.printf("%.1lfkmh", stats.max_speed);
+	lcd_print_fixed("", stats.max_speed, 1, 0, "kmh");
 	u8g2.setCursor(46, 42);
-	u8g2.printf("Alt:%.0lfm", stats.max_alt);
+	lcd_print_fixed("Alt:", stats.max_alt, 0, 0, "m");
 	u8g2.setCursor(93, 42);
-	u8g2.printf("Sat:%i", stats.max_sat);
+	lcd_print_int("Sat:", stats.max_sat, "");
 
+	// Maximum speed of this ride and the last sensor readings (see read_sensors())
 	u8g2.setFont(u8g2_font_profont12_tf);
-	u8g2.setCursor(21, 54);
-	u8g2.print("Average values:");
+	u8g2.setCursor(27, 54);
+	u8g2.print("Current ride:");
 	u8g2.drawLine(18, 55, 110, 55);
 	u8g2.setFont(u8g2_font_profont11_tf);
 	u8g2.setCursor(0, 64);
-	u8g2.printf("%.1lfkmh", 24.5);
+	lcd_print_fixed("", stats.ride_max_speed, 1, 0, "kmh");
 	u8g2.setCursor(46, 64);
-	u8g2.printf("T:%.0lfC", 35.6);
-	u8g2.setCursor(85, 64);
-	u8g2.printf("RH:%.0lf%%", 12.2);
+	if (sensors_read)
+	{
+		lcd_print_fixed("T:", temp, 0, 0, "C");
+		u8g2.setCursor(85, 64);
+		lcd_print_fixed("RH:", humid, 0, 0, "%");
+	}
+	else
+	{
+		u8g2.print("T:--");
+		u8g2.setCursor(85, 64);
+		u8g2.print("RH:--");
+	}
 
-	u8g2.sendBuffer();
+	lcd_submit(LCD_ALL_PAGES);
 }
 #endif
 
-void update_display()
+#ifdef ENABLE_GPS_DIAG_DISPLAY
+// Receive statistics of the GPS UART, everything but the sentences has to stay at 0
+void draw_gps_diag()
 {
 	u8g2.clearBuffer();
-	// Display Satellites
-	u8g2.setFont(u8g2_font_t0_12_tr);
-	u8g2.setCursor(0, 8);
-	u8g2.print("Sat.:" + String(gps_data.satellites));
-	// Display Battery Voltage
-	u8g2.setCursor(42, 8);
-	u8g2.print("B:" + String(read_battery_voltage(), 1) + "V");
 
-	// Display SD Info
-	u8g2.setFont(u8g2_font_profont10_tf);
-	u8g2.setCursor(0, 15);
-	if (SD_present)
-		u8g2.print("microSD: OK");
-	else
-		u8g2.print("microSD: X");
+	// Headline
+	u8g2.setFont(u8g2_font_9x18B_tf);
+	u8g2.setCursor(0, 10);
+	u8g2.print("GPS RX:");
+	u8g2.drawHLine(0, 12, 128);
 
-	// Display Course
-	/*
-	u8g2.setFont(u8g2_font_t0_12_tr);
-	u8g2.setCursor(0, 24);
-	u8g2.print("Course: " + String(gps.cardinal(gps_data.course)));*/
-
-	// Display runtime
-	u8g2.setFont(u8g2_font_t0_12_tr);
-	u8g2.setCursor(0, 24);
-	on_time_helper(true);
-	u8g2.print(time_running);
-
-	// Display Time
-	u8g2.setFont(u8g2_font_t0_12_tr);
-	u8g2.setCursor(81, 8);
-	u8g2.print(time_comb);
-	u8g2.drawHLine(81, 9, 47);
-	// Display Sensor Readings
-	u8g2.setFont(u8g2_font_5x7_mr);
-	u8g2.setCursor(81, 17);
-	u8g2.print(sensor_comb);
-	u8g2.drawHLine(76, 18, 52);
+	// Data
+	u8g2.setFont(u8g2_font_profont11_tf);
+	u8g2.setCursor(0, 22);
+	lcd_print_int("Sentences: ", gps.passedChecksum(), "");
+	u8g2.setCursor(0, 32);
+	lcd_print_int("Bad checksum: ", gps.failedChecksum(), "");
+	u8g2.setCursor(0, 42);
+	lcd_print_int("Overflow: ", gps_diag.fifo_overflows, "/");
+	lcd_print_int("", gps_diag.buffer_overflows, "");
+	u8g2.setCursor(0, 52);
+	lcd_print_int("Framing: ", gps_diag.framing_errors, "");
+	u8g2.setCursor(0, 62);
+	lcd_print_int("Max. buffered: ", gps_diag.max_buffered, "/");
+	lcd_print_int("", GPS_RX_BUFFER, "");
+
+	lcd_submit(LCD_ALL_PAGES);
+}
+#endif
 
-	// Display Speed
-	u8g2.setCursor(-2, u8g2.getDisplayHeight() - 11);
-	u8g2.setFont(u8g2_font_logisoso28_tf);
-	u8g2.print(String(gps_data.speed));
+#ifdef ENABLE_HISTORY_DISPLAY
+// Reads the index once when the screen is entered, in the SPI bus task (a slow card doesn't block the UI)
+void enter_history()
+{
+	history_state = HISTORY_LOADING;
+	sd_submit(SPI_SD_HISTORY, NULL);
+}
 
-	int speed_width = u8g2.getStrWidth(String(gps_data.speed).c_str());
-	u8g2.setCursor(speed_width + 2, u8g2.getDisplayHeight() - 11);
-	u8g2.setFont(u8g2_font_t0_11b_tf);
-	u8g2.print("km/h");
+void draw_history()
+{
+	u8g2.clearBuffer();
 
-	// Display Altitude
-	u8g2.setFont(u8g2_font_5x7_mf);
-	u8g2.setCursor(speed_width + 2, u8g2.getDisplayHeight() - 22);
-	u8g2.print("Alt.:" + String(gps_data.altitude));
-	int altitude_width = u8g2.getStrWidth(String("Alt:" + String(gps.altitude.meters())).c_str());
-	u8g2.setCursor(speed_width + altitude_width + 3, u8g2.getDisplayHeight() - 22);
-	u8g2.print("m");
+	// Headline
+	u8g2.setFont(u8g2_font_9x18B_tf);
+	u8g2.setCursor(0, 10);
+	u8g2.print("History:");
+	u8g2.drawHLine(0, 12, 128);
+
+	// Copy of the rides, the SPI bus task may swap in new ones meanwhile
+	ride_index_entry_struct entries[HISTORY_RIDES];
+	history_drawn_version = history_version;
+	portENTER_CRITICAL(&history_mux);
+	byte state = history_state;
+	byte count = history_count;
+	memcpy(entries, history, count * sizeof(ride_index_entry_struct));
+	portEXIT_CRITICAL(&history_mux);
 
-	// Display LAT and LNG
-	if (gps_data.speed < 10)
+	u8g2.setFont(u8g2_font_profont11_tf);
+	if (state == HISTORY_LOADING)
 	{
-		u8g2.setCursor(74, 26);
-		u8g2.print("Lat:" + String(gps.location.lat(), 4));
-		u8g2.setCursor(74, 34);
-		u8g2.print("Lng:" + String(gps.location.lng(), 4));
+		u8g2.setCursor(0, 26);
+		u8g2.print("Loading...");
 	}
-	else
+	else if (count == 0)
 	{
-		u8g2.setCursor(speed_width + 2, 26);
-		u8g2.print("Lat:" + String(gps.location.lat(), 3));
-		u8g2.setCursor(speed_width + 2, 34);
-		u8g2.print("Lng:" + String(gps.location.lng(), 3));
+		u8g2.setCursor(0, 26);
+		u8g2.print(state == HISTORY_READY ? "No rides yet" : "No microSD");
+	}
+	for (byte i = 0; state != HISTORY_LOADING && i < count; i++)
+	{
+		// Start date and time ("dd.mm hh:mm")
+		RtcDateTime start(entries[i].start_time);
+		char text[UI_TEXT_SIZE];
+		fixed_writer_struct w;
+		fixed_writer_init(&w, text, sizeof(text));
+		fixed_append_int(&w, start.Day(), 2, FIXED_ZERO_PAD);
+		fixed_append_char(&w, '.');
+		fixed_append_int(&w, start.Month(), 2, FIXED_ZERO_PAD);
+		fixed_append_char(&w, ' ');
+		fixed_append_int(&w, start.Hour(), 2, FIXED_ZERO_PAD);
+		fixed_append_char(&w, ':');
+		fixed_append_int(&w, start.Minute(), 2, FIXED_ZERO_PAD);
+		u8g2.setCursor(0, 24 + i * 11);
+		u8g2.print(text);
+		// Distance and duration ("h:mm")
+		u8g2.setCursor(67, 24 + i * 11);
+		lcd_print_fixed("", entries[i].distance_km, 1, 0, "km");
+		fixed_writer_init(&w, text, sizeof(text));
+		fixed_append_int(&w, entries[i].moving_time / 3600, 0, 0);
+		fixed_append_char(&w, ':');
+		fixed_append_int(&w, (entries[i].moving_time / 60) % 60, 2, FIXED_ZERO_PAD);
+		u8g2.setCursor(104, 24 + i * 11);
+		u8g2.print(text);
 	}
 
-	// Display travelled Distance and average speed
+	lcd_submit(LCD_ALL_PAGES);
+}
+#endif
+
+/*
+Retained UI of the main screen
+The static layout (labels, lines, symbols) is rendered once into ui_chrome.
+The buffer is kept between frames and only widgets whose text changed are cleared and redrawn.
+The large speed digits are copied from a glyph cache instead of being decoded from the font,
+and only the tile rows (pages) that changed are sent to the LCD.
+*/
+void ui_init()
+{
+	// Static layout
+	u8g2.clearBuffer();
+	u8g2.setFont(u8g2_font_t0_12_tr);
+	u8g2.setCursor(0, 8);
+	u8g2.print("Sat.:");
+	u8g2.setCursor(42, 8);
+	u8g2.print("B:");
+	u8g2.drawHLine(81, 9, 47);
+	u8g2.drawHLine(76, 18, 52);
+	ui_draw_symbols();
+	memcpy(ui_chrome, u8g2.getBufferPtr(), UI_BUFFER_SIZE);
 
-	u8g2.setCursor(0, u8g2.getDisplayHeight());
-	// Draw sum and average symbols
+	// Pre-rasterise the speed digits, the columns of every page are copied out of the buffer
+	uint8_t *buffer = u8g2.getBufferPtr();
+	int stride = u8g2.getBufferTileWidth() * 8;
+	u8g2.setFont(u8g2_font_logisoso28_tf);
+	for (byte i = 0; i < sizeof(ui_speed_glyphs) / sizeof(ui_glyph_struct); i++)
+	{
+		u8g2.clearBuffer();
+		int width = u8g2.drawGlyph(0, UI_SPEED_BASELINE, ui_speed_chars[i]);
+		ui_speed_glyphs[i].width = width < UI_GLYPH_MAX_WIDTH ? width : UI_GLYPH_MAX_WIDTH;
+		for (byte page = 0; page < UI_SPEED_PAGES; page++)
+		{
+			memcpy(ui_speed_glyphs[i].columns[page], buffer + (UI_SPEED_FIRST_PAGE + page) * stride, ui_speed_glyphs[i].width);
+		}
+	}
+	u8g2.clearBuffer();
+	ui_valid = 0;
+}
+
+// Sum and average symbols in the bottom row
+void ui_draw_symbols()
+{
 	u8g2.setFont(u8g2_font_unifont_t_greek);
 	u8g2.drawGlyph(0, u8g2.getDisplayHeight(), 0x03a3);
 	u8g2.setCursor(6, u8g2.getDisplayHeight());
@@ -1380,7 +2765,235 @@ void update_display()
 	u8g2.drawGlyph(u8g2.getDisplayWidth() / 2, u8g2.getDisplayHeight(), 0x0030);
 	u8g2.setCursor(u8g2.getDisplayWidth() / 2 + 6, u8g2.getDisplayHeight());
 	u8g2.print(":");
+}
+
+// Copies the speed digits out of the glyph cache, returns the width
+int ui_draw_speed(int x, const char *text)
+{
+	uint8_t *buffer = u8g2.getBufferPtr();
+	int stride = u8g2.getBufferTileWidth() * 8;
+	int start = x;
+
+	for (const char *c = text; *c; c++)
+	{
+		const char *found = strchr(ui_speed_chars, *c);
+		if (!found)
+		{
+			continue;
+		}
+		const ui_glyph_struct *glyph = &ui_speed_glyphs[found - ui_speed_chars];
+		for (byte page = 0; page < UI_SPEED_PAGES; page++)
+		{
+			uint8_t *row = buffer + (UI_SPEED_FIRST_PAGE + page) * stride;
+			for (byte column = 0; column < glyph->width; column++)
+			{
+				if (x + column >= 0 && x + column < stride)
+					row[x + column] |= glyph->columns[page][column];
+			}
+		}
+		x += glyph->width;
+	}
+	return x - start;
+}
+
+// Returns true (and remembers the new text) if the text of a widget changed
+bool ui_widget_changed(char *cache, const char *text)
+{
+	if (strcmp(cache, text) == 0)
+	{
+		return 0;
+	}
+	strncpy(cache, text, UI_TEXT_SIZE - 1);
+	cache[UI_TEXT_SIZE - 1] = '\0';
+	return 1;
+}
+
+// Clears the area of a widget and marks its pages for sending
+void ui_clear_box(int x, int y, int w, int h)
+{
+	u8g2.setDrawColor(0);
+	u8g2.drawBox(x, y, w, h);
+	u8g2.setDrawColor(1);
+	for (int page = y / 8; page <= (y + h - 1) / 8; page++)
+	{
+		ui_dirty_pages |= 1 << page;
+	}
+}
+
+// Prints "<prefix><value><suffix>" at the cursor (see fixed_format.h, same text as printf)
+void lcd_print_fixed(const char *prefix, double value, uint8_t decimals, uint8_t flags, const char *suffix)
+{
+	char text[UI_TEXT_SIZE];
+	fixed_writer_struct w;
+	fixed_writer_init(&w, text, sizeof(text));
+	fixed_append_text(&w, prefix);
+	fixed_append_double(&w, value, decimals, 0, flags);
+	fixed_append_text(&w, suffix);
+	u8g2.print(text);
+}
 
+// Same for integers
+void lcd_print_int(const char *prefix, long value, const char *suffix)
+{
+	char text[UI_TEXT_SIZE];
+	fixed_writer_struct w;
+	fixed_writer_init(&w, text, sizeof(text));
+	fixed_append_text(&w, prefix);
+	fixed_append_int(&w, value, 0, 0);
+	fixed_append_text(&w, suffix);
+	u8g2.print(text);
+}
+
+void update_display()
+{
+	char text[UI_TEXT_SIZE];
+	unsigned long compose_start = micros();
+
+	if (!ui_valid)
+	{ // Screen was entered: start with the static layout and draw every widget
+		memcpy(u8g2.getBufferPtr(), ui_chrome, UI_BUFFER_SIZE);
+		memset(&ui_main, 0, sizeof(ui_main));
+		ui_dirty_pages = 0xFF;
+		ui_valid = 1;
+	}
+
+	// Display Satellites
+	fixed_writer_struct w;
+	fixed_writer_init(&w, text, sizeof(text));
+	fixed_append_int(&w, gps_data.satellites, 0, 0);
+	if (ui_widget_changed(ui_main.satellites, text))
+	{
+		ui_clear_box(30, 0, 12, 9);
+		u8g2.setFont(u8g2_font_t0_12_tr);
+		u8g2.setCursor(30, 8);
+		u8g2.print(text);
+	}
+
+	// Display Battery Voltage and remaining runtime (alternating)
+	fixed_writer_init(&w, text, sizeof(text));
+	if ((seconds_running / 3) % 2 == 0)
+	{
+		fixed_append_double(&w, battery.voltage, 1, 0, 0);
+		fixed_append_char(&w, 'V');
+	}
+	else
+	{
+		fixed_append_double(&w, battery.runtime_h, battery.runtime_h < 10 ? 1 : 0, 0, 0);
+		fixed_append_char(&w, 'h');
+	}
+	if (ui_widget_changed(ui_main.battery, text))
+	{
+		ui_clear_box(54, 0, 26, 9);
+		u8g2.setFont(u8g2_font_t0_12_tr);
+		u8g2.setCursor(54, 8);
+		u8g2.print(text);
+	}
+
+	// Display SD Info
+	if (sd_state == SD_STATE_OK)
+		snprintf(text, sizeof(text), "microSD: OK");
+	else if (sd_state == SD_STATE_MOUNTING)
+		snprintf(text, sizeof(text), "microSD: mount");
+	else if (sd_state == SD_STATE_DRAINING)
+		snprintf(text, sizeof(text), "microSD: sync %u", backlog_rows);
+	else if (backlog_rows > 0)
+		snprintf(text, sizeof(text), "microSD: X %u", backlog_rows);
+	else
+		snprintf(text, sizeof(text), "microSD: X");
+	if (ui_widget_changed(ui_main.sd, text))
+	{
+		ui_clear_box(0, 9, 76, 7);
+		u8g2.setFont(u8g2_font_profont10_tf);
+		u8g2.setCursor(0, 15);
+		u8g2.print(text);
+	}
+
+	// Display Course
+	/*
+	u8g2.setFont(u8g2_font_t0_12_tr);
+	u8g2.setCursor(0, 24);
+	u8g2.print("Course: " + String(gps.cardinal(gps_data.course)));*/
+
+	// Display runtime
+	on_time_helper(true);
+	if (ui_widget_changed(ui_main.runtime, time_running.c_str()))
+	{
+		ui_clear_box(0, 16, 50, 9);
+		u8g2.setFont(u8g2_font_t0_12_tr);
+		u8g2.setCursor(0, 24);
+		u8g2.print(time_running);
+	}
+
+	// Display Time
+	if (ui_widget_changed(ui_main.time, time_comb.c_str()))
+	{
+		ui_clear_box(81, 0, 47, 9);
+		u8g2.setFont(u8g2_font_t0_12_tr);
+		u8g2.setCursor(81, 8);
+		u8g2.print(time_comb);
+	}
+	// Display Sensor Readings
+	if (ui_widget_changed(ui_main.sensor, sensor_comb.c_str()))
+	{
+		ui_clear_box(77, 10, 51, 8);
+		u8g2.setFont(u8g2_font_5x7_mr);
+		u8g2.setCursor(81, 17);
+		u8g2.print(sensor_comb);
+	}
+
+	// Speed, grade, altitude and position move with the width of the speed, so they are one widget
+	char speed_text[12];
+	fixed_format(speed_text, sizeof(speed_text), gps_data.speed, 2, 0, 0);
+	fixed_writer_init(&w, text, sizeof(text));
+	fixed_append_text(&w, speed_text);
+	fixed_append_char(&w, '|');
+	fixed_append_double(&w, climb.grade, 0, 0, 0);
+	fixed_append_char(&w, '|');
+	fixed_append_double(&w, gps_data.altitude, 2, 0, 0);
+	fixed_append_char(&w, '|');
+	fixed_append_double(&w, gps.location.lat(), 4, 0, 0);
+	fixed_append_char(&w, '|');
+	fixed_append_double(&w, gps.location.lng(), 4, 0, 0);
+	if (ui_widget_changed(ui_main.speed, text))
+	{
+		ui_clear_box(0, 25, 128, 29);
+		ui_clear_box(50, 19, 78, 6);
+
+		// Display Speed
+		int speed_width = ui_draw_speed(-2, speed_text);
+		u8g2.setCursor(speed_width + 2, u8g2.getDisplayHeight() - 11);
+		u8g2.setFont(u8g2_font_t0_11b_tf);
+		u8g2.print("km/h");
+
+		// Display Grade
+		u8g2.setFont(u8g2_font_5x7_mf);
+		lcd_print_fixed("", climb.grade, 0, FIXED_PLUS, "%");
+
+		// Display Altitude
+		u8g2.setCursor(speed_width + 2, u8g2.getDisplayHeight() - 22);
+		lcd_print_fixed("Alt.:", gps_data.altitude, 2, 0, "m");
+
+		// Display LAT and LNG
+		if (gps_data.speed < 10)
+		{
+			u8g2.setCursor(74, 26);
+			lcd_print_fixed("Lat:", gps.location.lat(), 4, 0, "");
+			u8g2.setCursor(74, 34);
+			lcd_print_fixed("Lng:", gps.location.lng(), 4, 0, "");
+		}
+		else
+		{
+			u8g2.setCursor(speed_width + 2, 26);
+			lcd_print_fixed("Lat:", gps.location.lat(), 3, 0, "");
+			u8g2.setCursor(speed_width + 2, 34);
+			lcd_print_fixed("Lng:", gps.location.lng(), 3, 0, "");
+		}
+
+		// The symbols reach into the cleared area
+		ui_draw_symbols();
+	}
+
+	// Display travelled Distance and average speed
 	// Total distance
 	int decimal_places = 2;
 	if (gps_data.travel_distance_km >= 100.0)
@@ -1391,11 +3004,16 @@ void update_display()
 	{
 		decimal_places = 1;
 	}
-	u8g2.setFont(u8g2_font_8x13B_tr);
-	u8g2.setCursor(13, u8g2.getDisplayHeight());
-	u8g2.print(String(gps_data.travel_distance_km, decimal_places));
-	u8g2.setFont(u8g2_font_6x13_mr);
-	u8g2.print("km");
+	fixed_format(text, sizeof(text), gps_data.travel_distance_km, decimal_places, 0, 0);
+	if (ui_widget_changed(ui_main.distance, text))
+	{
+		ui_clear_box(13, 54, 51, 10);
+		u8g2.setFont(u8g2_font_8x13B_tr);
+		u8g2.setCursor(13, u8g2.getDisplayHeight());
+		u8g2.print(text);
+		u8g2.setFont(u8g2_font_6x13_mr);
+		u8g2.print("km");
+	}
 
 	// Average speed
 	decimal_places = 2;
@@ -1407,15 +3025,36 @@ void update_display()
 	{
 		decimal_places = 1;
 	}
-
-	u8g2.setFont(u8g2_font_8x13B_tr);
-	u8g2.setCursor(u8g2.getDisplayWidth() / 2 + 13, u8g2.getDisplayHeight());
-	u8g2.print(String(stats.avg_speed, decimal_places));
-	u8g2.setFont(u8g2_font_6x13_mr);
-	u8g2.print("kmh");
+	fixed_format(text, sizeof(text), stats.avg_speed, decimal_places, 0, 0);
+	if (ui_widget_changed(ui_main.avg_speed, text))
+	{
+		ui_clear_box(u8g2.getDisplayWidth() / 2 + 13, 54, 51, 10);
+		u8g2.setFont(u8g2_font_8x13B_tr);
+		u8g2.setCursor(u8g2.getDisplayWidth() / 2 + 13, u8g2.getDisplayHeight());
+		u8g2.print(text);
+		u8g2.setFont(u8g2_font_6x13_mr);
+		u8g2.print("kmh");
+	}
 
 	////////////////////
-	u8g2.sendBuffer();
+	// Only send the pages that changed
+	unsigned long send_start = micros();
+	for (byte page = 0; page < u8g2.getBufferTileHeight(); page++)
+	{
+		if (ui_dirty_pages & (1 << page))
+			ui_timing.pages++;
+	}
+	lcd_submit(ui_dirty_pages);
+	ui_dirty_pages = 0;
+
+	ui_timing.compose_us += send_start - compose_start;
+	ui_timing.send_us += micros() - send_start;
+	ui_timing.frames++;
+	if (ui_timing.frames >= UI_TIMING_FRAMES)
+	{
+		LOG_DEBUG(LOG_ID_UI_TIMING, ui_timing.compose_us / ui_timing.frames, ui_timing.send_us / ui_timing.frames, ui_timing.pages * 10 / ui_timing.frames);
+		memset(&ui_timing, 0, sizeof(ui_timing));
+	}
 }
 // END GUI
 /////////////////////////////////////////////////////////////////////////
@@ -1435,9 +3074,10 @@ void calculate_total_dist()
 	{
 		current_total_dist = gps_data.travel_distance_km;
 		stats.total_dist = stats.total_dist + gps_data.travel_distance_km;
+		screen_data_update(SCREEN_DATA_STATS);
 		preferences.begin("pref_stats", false);
 		preferences.putDouble("total_dist", stats.total_dist);
-		Serial.println("logging dist");
+		LOG_INFO(LOG_ID_STORE_DIST, lround(stats.total_dist * 1000));
 		preferences.end();
 	}
 }
@@ -1459,11 +3099,12 @@ void calculate_max()
 	if (gps.speed.kmph() > stats.max_speed)
 	{
 		stats.max_speed = gps.speed.kmph();
+		screen_data_update(SCREEN_DATA_STATS);
 		if (max_speed < stats.max_speed)
 		{
 			max_speed = stats.max_speed;
 			preferences.putDouble("max_speed", max_speed);
-			Serial.println("logging speed");
+			LOG_INFO(LOG_ID_STORE_SPEED, lround(max_speed * 1000));
 		}
 	}
 
@@ -1471,11 +3112,12 @@ void calculate_max()
 	if (gps.altitude.meters() > stats.max_alt)
 	{
 		stats.max_alt = gps.altitude.meters();
+		screen_data_update(SCREEN_DATA_STATS);
 		if (max_alt < (int)stats.max_alt)
 		{
 			max_alt = (int)stats.max_alt;
 			preferences.putInt("max_alt", max_alt);
-			Serial.println("logging alt");
+			LOG_INFO(LOG_ID_STORE_ALT, max_alt);
 		}
 	}
 
@@ -1483,11 +3125,12 @@ void calculate_max()
 	if (gps.satellites.value() > stats.max_sat)
 	{
 		stats.max_sat = gps.satellites.value();
+		screen_data_update(SCREEN_DATA_STATS);
 		if (max_sat < stats.max_sat)
 		{
 			max_sat = stats.max_sat;
 			preferences.putInt("max_sat", max_sat);
-			Serial.println("logging sat");
+			LOG_INFO(LOG_ID_STORE_SAT, max_sat);
 		}
 	}
 
@@ -1608,72 +3251,602 @@ void init_ota()
 
 /////////////////////////////////////////////////////////////////////////
 // SD
+// Formats the current fix as a CSV row and as fix for the track codec
+void sd_format_row(log_record_struct *record, track_fix_struct *fix)
+{
+	record->time = gps_time_seconds();
+	record->lat = gps.location.lat();
+	record->lng = gps.location.lng();
+	record->distance_km = gps_data.travel_distance_km;
+	// Last values of read_sensors() (no I2C access here), empty fields while the sensor is starting
+	bool sensor_valid = sensors_read;
+	float temperature = sensor_valid ? temp : NAN;
+	float humidity = sensor_valid ? humid : NAN;
+
+	// Same text as "%10.7lf,%10.7lf,%i:%i:%i,%6.3f,%i,%5.2f,%5.2f,%i,%5.2f,%.1f,%.1f,%.1f,%.1f,%.2f,\n" without printf
+	// (like track_format_row(), temperature and humidity are empty without a reading)
+	fixed_writer_struct w;
+	fixed_writer_init(&w, record->row, sizeof(record->row));
+	fixed_append_double(&w, record->lat, 7, 10, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, record->lng, 7, 10, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_int(&w, gps.time.hour(), 0, 0);
+	fixed_append_char(&w, ':');
+	fixed_append_int(&w, gps.time.minute(), 0, 0);
+	fixed_append_char(&w, ':');
+	fixed_append_int(&w, gps.time.second(), 0, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, gps.speed.kmph(), 3, 6, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_int(&w, gps.satellites.value(), 0, 0);
+	fixed_append_char(&w, ',');
+	if (sensor_valid)
+	{
+		fixed_append_double(&w, temperature, 2, 5, 0);
+	}
+	fixed_append_char(&w, ',');
+	if (sensor_valid)
+	{
+		fixed_append_double(&w, humidity, 2, 5, 0);
+	}
+	fixed_append_char(&w, ',');
+	fixed_append_int(&w, ldr_reading, 0, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, gps_data.travel_distance_km, 2, 5, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, gps.altitude.meters(), 1, 0, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, climb.total_ascent, 1, 0, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, climb.total_descent, 1, 0, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, climb.grade, 1, 0, 0);
+	fixed_append_char(&w, ',');
+	fixed_append_double(&w, battery.voltage, 2, 0, 0);
+	fixed_append_text(&w, ",\n");
+	record->length = w.length < sizeof(record->row) ? w.length : sizeof(record->row) - 1;
+
+	fix->value[TRACK_TIME] = record->time;
+	track_fix_set(fix, TRACK_LAT, record->lat);
+	track_fix_set(fix, TRACK_LNG, record->lng);
+	track_fix_set(fix, TRACK_SPEED, gps.speed.kmph());
+	track_fix_set(fix, TRACK_SATELLITES, gps.satellites.value());
+	track_fix_set(fix, TRACK_TEMPERATURE, temperature);
+	track_fix_set(fix, TRACK_HUMIDITY, humidity);
+	track_fix_set(fix, TRACK_LIGHT, ldr_reading);
+	track_fix_set(fix, TRACK_DISTANCE, gps_data.travel_distance_km);
+	track_fix_set(fix, TRACK_ALTITUDE, gps.altitude.meters());
+	track_fix_set(fix, TRACK_ASCENT, climb.total_ascent);
+	track_fix_set(fix, TRACK_DESCENT, climb.total_descent);
+	track_fix_set(fix, TRACK_GRADE, climb.grade);
+	track_fix_set(fix, TRACK_BATTERY, battery.voltage);
+#ifdef ENABLE_TRACK_COMPRESSION
+	record->fix = *fix;
+#endif
+}
+
+// Logs the current fix to SD, or to the RAM backlog while the card is missing
+void log_fix()
+{
+	if (gps.location.age() >= 3000 /* || !gps.location.isUpdated()*/)
+	{
+		return;
+	}
+#ifdef ENABLE_LOG_DECIMATION
+	if (!log_decimator_keep(&log_decimator, millis(), gps.location.lat(), gps.location.lng()))
+	{
+		return;
+	}
+#endif
+
+	log_record_struct record;
+	track_fix_struct fix;
+	sd_format_row(&record, &fix);
+
+	// Kept in RTC memory until the row is on the card
+	record.seq = rtc_track_add(&rtc_track, &fix);
+
+	// Written (or buffered) by the SPI bus task
+	sd_submit(SPI_SD_ROW, &record);
+}
+
+// The row is on the card: save the log position and release the fix in the RTC track
+void sd_row_persisted(const log_record_struct *record)
+{
+	save_log_position();
+	rtc_track_persisted(&rtc_track, record->seq);
+}
+
 // Saves data to SD
-bool sd_log_data()
+bool sd_log_data(const log_record_struct *record)
 {
-	bool status = 1;
 	sd_log_count += 1;
-	if (SD_present)
+
+	// Rows must not cross a chunk boundary
+	bool status = sd_reserve_chunk_space(record->length);
+	log_chunk_add_fix(&log_chunk, record->time, record->lat, record->lng, record->distance_km);
+	status &= sd_write_log(record->row, record->length);
+	file.flush();
+#ifdef ENABLE_TRACK_COMPRESSION
+	if (!track_log_fix(&record->fix))
 	{
-		if (gps.location.age() < 3000 /* && gps.location.isUpdated()*/)
-		{
-			file.printf("%10.7lf", gps.location.lat());
-			file.print(",");
-			file.printf("%10.7lf", gps.location.lng());
-			file.print(",");
-			file.printf("%i:%i:%i,", gps.time.hour(), gps.time.minute(), gps.time.second());
-			file.printf("%6.3f,", gps.speed.kmph());
-			file.printf("%i,", gps.satellites.value());
-			file.printf("%5.2f,", ht2x.readTemperature());
-			file.printf("%5.2f,", ht2x.readHumidity());
-			file.printf("%i,", analogRead(ldr_pin));
-			file.printf("%5.2f,", gps_data.travel_distance_km);
-			file.print("\n");
-			file.flush();
+		LOG_WARN(LOG_ID_TRACK_WRITE, track_block_index);
+	}
+#endif
 #ifdef DEBUG
-			// Serial.println("Logging successful!");
+	// Serial.println("Logging successful!");
 #endif // DEBUG
+	return status;
+}
+
+// Mounts the card (the SPI bus has to be taken already)
+bool sd_mount()
+{
+	file.close();
+#ifdef ENABLE_TRACK_COMPRESSION
+	track_file.close();
+#endif
+	if (!sd.begin(SD_CHIP_SELECT, SD_SCK_MHZ(SD_SPEED)))
+	{
+		return 0;
+	}
+
+	uint32_t cardSize = sd.card()->cardSize();
+	LOG_INFO(LOG_ID_SD_CARD_SIZE, lround(cardSize * 0.000512));
+	return 1;
+}
+
+// Writes all rows of the backlog to the card (the SPI bus has to be taken already)
+// SD_present is set together with the check for an empty backlog, so no new row can overtake the old ones
+// The bus is given back after every row, so queued LCD frames go out in between (the SPI bus task has the higher priority)
+bool sd_drain_backlog()
+{
+	log_record_struct record;
+	unsigned int rows = 0;
+
+	while (true)
+	{
+		portENTER_CRITICAL(&backlog_mux);
+		bool available = backlog_peek(&record);
+		if (!available)
+		{
+			SD_present = 1;
+			sd_state = SD_STATE_OK;
 		}
+		portEXIT_CRITICAL(&backlog_mux);
+
+		if (!available)
+		{
+			break;
+		}
+		if (!sd_log_data(&record))
+		{
+			return 0;
+		}
+		sd_row_persisted(&record);
+
+		portENTER_CRITICAL(&backlog_mux);
+		backlog_pop();
+		portEXIT_CRITICAL(&backlog_mux);
+		rows++;
+
+		// Until SD_present is set the bus task doesn't touch the card, it only buffers new rows
+		sd_bus_end();
+		sd_bus_begin();
 	}
-	else
+
+	// The bus task may count a dropped row at the same time
+	portENTER_CRITICAL(&backlog_mux);
+	unsigned long dropped = backlog_dropped;
+	backlog_dropped = 0;
+	portEXIT_CRITICAL(&backlog_mux);
+	if (rows > 0 || dropped > 0)
 	{
-		status = 0;
+		LOG_INFO(LOG_ID_SD_BACKLOG, rows, dropped);
+	}
+	return 1;
+}
+
+// Copies bytes into / out of the ring buffer
+void backlog_write_bytes(size_t pos, const void *data, size_t length)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	for (size_t i = 0; i < length; i++)
+	{
+		sd_backlog[(pos + i) % SD_BACKLOG_SIZE] = p[i];
+	}
+}
+
+void backlog_read_bytes(size_t pos, void *data, size_t length)
+{
+	uint8_t *p = (uint8_t *)data;
+	for (size_t i = 0; i < length; i++)
+	{
+		p[i] = sd_backlog[(pos + i) % SD_BACKLOG_SIZE];
+	}
+}
+
+// Adds a row to the backlog, drops the oldest rows if there is no space left
+// Must be called with backlog_mux taken
+void backlog_push(const log_record_struct *record)
+{
+	size_t size = LOG_RECORD_HEADER_SIZE + record->length;
+
+	while (SD_BACKLOG_SIZE - backlog_used < size && backlog_rows > 0)
+	{
+		backlog_pop();
+		backlog_dropped++;
+	}
+
+	backlog_write_bytes(backlog_head, record, size);
+	backlog_head = (backlog_head + size) % SD_BACKLOG_SIZE;
+	backlog_used += size;
+	backlog_rows++;
+}
+
+// Reads the oldest row without removing it, must be called with backlog_mux taken
+bool backlog_peek(log_record_struct *record)
+{
+	if (backlog_rows == 0)
+	{
+		return 0;
+	}
+	backlog_read_bytes(backlog_tail, record, LOG_RECORD_HEADER_SIZE);
+	backlog_read_bytes(backlog_tail + LOG_RECORD_HEADER_SIZE, record->row, record->length);
+	return 1;
+}
+
+// Removes the oldest row, must be called with backlog_mux taken
+void backlog_pop()
+{
+	if (backlog_rows == 0)
+	{
+		return;
+	}
+	log_record_struct header;
+	backlog_read_bytes(backlog_tail, &header, LOG_RECORD_HEADER_SIZE);
+	size_t size = LOG_RECORD_HEADER_SIZE + header.length;
+	backlog_tail = (backlog_tail + size) % SD_BACKLOG_SIZE;
+	backlog_used -= size;
+	backlog_rows--;
+}
+
+// Writes data to the current chunk of the log and updates its CRC
+bool sd_write_log(const char *data, size_t length)
+{
+	log_chunk_add_data(&log_chunk, data, length);
+	return file.write(data, length) == length;
+}
+
+// Makes sure that length bytes fit into the current chunk
+// Otherwise the rest of the chunk is filled up and a new one is started
+bool sd_reserve_chunk_space(size_t length)
+{
+	if (length <= log_chunk_free(&log_chunk))
+	{
+		return 1;
 	}
+
+	bool status = 1;
+	char padding[64];
+	memset(padding, ' ', sizeof(padding));
+	size_t remaining = log_chunk_free(&log_chunk);
+	while (remaining > 0)
+	{
+		size_t n = remaining < sizeof(padding) ? remaining : sizeof(padding);
+		if (n == remaining)
+		{
+			padding[n - 1] = '\n';
+		}
+		status &= sd_write_log(padding, n);
+		remaining -= n;
+	}
+
+	// Finish the summary of the full chunk and write an empty one for the next
+	status &= sd_write_chunk_header();
+	log_chunk_begin(&log_chunk, log_chunk.index + 1);
+	status &= sd_write_chunk_header();
+	return status;
+}
+
+// Writes the CSV header as the first line of the file and fills the rest of chunk 0 with spaces,
+// so spreadsheet programs see the column names first and chunk 1 starts at LOG_CHUNK_SIZE
+bool sd_write_csv_header()
+{
+	const char csv_header[] = "Latitude,Longitude,Time,Speed,Satellites,Temperature,Humidity,Light,Distance,Altitude,Ascent,Descent,Grade,Battery,\r\n";
+	bool status = file.seekSet(0) && file.write(csv_header, sizeof(csv_header) - 1) == sizeof(csv_header) - 1;
+
+	char padding[64];
+	memset(padding, ' ', sizeof(padding));
+	size_t remaining = LOG_CHUNK_SIZE - (sizeof(csv_header) - 1);
+	while (remaining > 0)
+	{
+		size_t n = remaining < sizeof(padding) ? remaining : sizeof(padding);
+		if (n == remaining)
+		{
+			padding[n - 1] = '\n';
+		}
+		status &= file.write(padding, n) == n;
+		remaining -= n;
+	}
+	return status;
+}
+
+// (Re)writes the summary line at the start of the current chunk
+bool sd_write_chunk_header()
+{
+	char header[LOG_CHUNK_HEADER_SIZE];
+	uint32_t chunk_pos = log_chunk.index * LOG_CHUNK_SIZE;
+
+	log_chunk_format_header(&log_chunk, header);
+	bool status = file.seekSet(chunk_pos) && file.write(header, sizeof(header)) == sizeof(header);
+
+	// Continue writing after the last row
+	status &= file.seekSet(chunk_pos + LOG_CHUNK_HEADER_SIZE + log_chunk.length);
 	return status;
 }
 
+// GPS time as seconds since 2000 (local time, like the RTC)
+uint32_t gps_time_seconds()
+{
+	RtcDateTime gps_time(gps.date.year(), gps.date.month(), gps.date.day(), gps.time.hour(), gps.time.minute(), gps.time.second());
+	return gps_time.TotalSeconds() + UTC_ADJ * 3600;
+}
+
+#ifdef ENABLE_TRACK_COMPRESSION
+// Adds a fix to the compressed track, a full block is written and a new one started
+bool track_log_fix(const track_fix_struct *fix)
+{
+	if (!track_file.isOpen())
+	{
+		return 0;
+	}
+
+	unsigned long start = micros();
+	if (track_encoder_add(&track_encoder, fix))
+	{
+		track_encode_us = micros() - start;
+		return 1;
+	}
+
+	bool status = track_write_block();
+	track_file.flush();
+	LOG_DEBUG(LOG_ID_TRACK_BLOCK, track_block_index, track_encoder.fixes, TRACK_BLOCK_HEADER_SIZE + track_encoder.length, track_encode_us);
+	track_block_index++;
+
+	start = micros();
+	track_encoder_next_block(&track_encoder);
+	track_encoder_add(&track_encoder, fix);
+	track_encode_us = micros() - start;
+	return status;
+}
+
+// Writes the current block (also a partial one) at its position in the track file
+bool track_write_block()
+{
+	if (!track_file.isOpen() || track_encoder.fixes == 0)
+	{
+		return 1;
+	}
+	const uint8_t *block = track_encoder_block(&track_encoder);
+	return track_file.seekSet(track_block_index * TRACK_BLOCK_SIZE) && track_file.write(block, TRACK_BLOCK_SIZE) == TRACK_BLOCK_SIZE;
+}
+
+// Opens the track file next to the log file (*.trk instead of *.csv)
+// A resumed ride continues with a new block after the last one that was written
+bool track_open(bool resume)
+{
+	char name[sizeof(fileName)];
+	strncpy(name, fileName, sizeof(name));
+	name[sizeof(name) - 1] = '\0';
+	char *extension = strrchr(name, '.');
+	if (extension == NULL || strlen(extension) != 4)
+	{
+		return 0;
+	}
+	strcpy(extension, ".trk");
+
+	track_encoder_init(&track_encoder, TRACK_LZ);
+	track_file.close();
+	if (!track_file.open(name, O_RDWR | O_CREAT))
+	{
+		return 0;
+	}
+	if (!resume)
+	{
+		track_file.truncate(0);
+	}
+	track_block_index = (track_file.fileSize() + TRACK_BLOCK_SIZE - 1) / TRACK_BLOCK_SIZE;
+	return 1;
+}
+#endif
+
 bool init_sd_logger()
 {
 	bool status = 1;
 
+	// The checkpoint must not point to the previous file while this one is created
+	clear_log_position();
+
 	// Get appropriate filename with correct name
 	set_filename();
 
 	// Check if file exists
 	if (sd.exists(fileName))
 	{
-#ifdef DEBUG
-		Serial.println("Error file already exists!");
-#endif // DEBUG
+		LOG_ERROR(LOG_ID_SD_FILE_EXISTS);
 		status = 0;
 	}
 	// Open file
 	if (!file.open(fileName, O_RDWR | O_CREAT))
 	{
-#ifdef DEBUG
-		Serial.println("Error while opening file!");
-#endif // DEBUG
+		LOG_ERROR(LOG_ID_SD_OPEN);
 		status = 0;
 	}
 	// Set timestamps
-	status = SD_set_timestamps();
+	status &= SD_set_timestamps();
 
 	// Print CSV Data
-	file.println("Latitude,Longitude,Time,Speed,Satellites,Temperature,Humidity,Light,Distance,");
+	status &= sd_write_csv_header();
+
+	// Empty summary of the first chunk, right after the CSV header block
+	log_chunk_begin(&log_chunk, 1);
+	status &= sd_write_chunk_header();
 	file.flush();
+#ifdef ENABLE_TRACK_COMPRESSION
+	if (!track_open(0))
+	{
+		LOG_ERROR(LOG_ID_SD_OPEN);
+	}
+#endif
+
+	// Add the new ride to the index
+	if (!init_ride_index())
+	{
+		LOG_ERROR(LOG_ID_SD_RIDE_INDEX);
+	}
+
+	// From now on a reset continues this file
+	if (status)
+	{
+		save_log_position();
+	}
+	return status;
+}
+
+// Fills in the index entry of the current ride
+void fill_ride_index_entry(ride_index_entry_struct *entry)
+{
+	memset(entry, 0, sizeof(ride_index_entry_struct));
+	strncpy(entry->file_name, fileName, RIDE_INDEX_NAME_LENGTH - 1);
+	entry->start_time = ride_start_time;
+	entry->end_time = clock_seconds;
+	entry->distance_km = gps_data.travel_distance_km;
+	entry->max_speed = stats.ride_max_speed;
+	entry->moving_time = stats.moving_time / 1000;
+	entry->checkpoint_pos = file.fileSize();
+	entry->magic = RIDE_INDEX_MAGIC;
+}
+
+// Appends an entry for the current ride to the index file, only for a new log file
+bool init_ride_index()
+{
+	SdFile index_file;
+	ride_index_entry_struct entry;
+
+	if (!index_file.open(RIDE_INDEX_FILENAME, O_RDWR | O_CREAT))
+	{
+		return 0;
+	}
+
+	// Append after the last complete entry (ignores a partially written one)
+	ride_index_pos = (index_file.fileSize() / RIDE_INDEX_ENTRY_SIZE) * RIDE_INDEX_ENTRY_SIZE;
+	ride_start_time = clock_seconds;
+	fill_ride_index_entry(&entry);
+
+	bool status = index_file.seekSet(ride_index_pos) && index_file.write(&entry, sizeof(entry)) == sizeof(entry);
+	index_file.close();
+	last_ride_index_update = millis();
 	return status;
 }
 
+// Finds the entry of the continued log file (resume after a reset or a remount) and updates it
+// ride_index_pos of the checkpoint is only a hint, the index may have been changed on another card
+// Appends a new entry (with the old start time) if the file isn't in the index
+bool continue_ride_index()
+{
+	SdFile index_file;
+	ride_index_entry_struct entry;
+
+	if (!index_file.open(RIDE_INDEX_FILENAME, O_RDWR | O_CREAT))
+	{
+		return 0;
+	}
+	uint32_t entries = index_file.fileSize() / RIDE_INDEX_ENTRY_SIZE;
+	bool found = 0;
+	if (ride_index_pos % RIDE_INDEX_ENTRY_SIZE == 0 && ride_index_pos / RIDE_INDEX_ENTRY_SIZE < entries && index_file.seekSet(ride_index_pos) &&
+		index_file.read(&entry, sizeof(entry)) == sizeof(entry))
+	{
+		found = entry.magic == RIDE_INDEX_MAGIC && strncmp(entry.file_name, fileName, RIDE_INDEX_NAME_LENGTH) == 0;
+	}
+	// Newest entries first, the ride is usually one of the last ones
+	for (uint32_t i = entries; !found && i > 0; i--)
+	{
+		if (!index_file.seekSet((i - 1) * RIDE_INDEX_ENTRY_SIZE) || index_file.read(&entry, sizeof(entry)) != sizeof(entry))
+		{
+			break;
+		}
+		if (entry.magic == RIDE_INDEX_MAGIC && strncmp(entry.file_name, fileName, RIDE_INDEX_NAME_LENGTH) == 0)
+		{
+			found = 1;
+			ride_index_pos = (i - 1) * RIDE_INDEX_ENTRY_SIZE;
+		}
+	}
+	if (found)
+	{
+		ride_start_time = entry.start_time;
+	}
+	else
+	{
+		ride_index_pos = entries * RIDE_INDEX_ENTRY_SIZE;
+	}
+	fill_ride_index_entry(&entry);
+
+	bool status = index_file.seekSet(ride_index_pos) && index_file.write(&entry, sizeof(entry)) == sizeof(entry);
+	index_file.close();
+	last_ride_index_update = millis();
+	return status;
+}
+
+// Rewrites the entry of the current ride
+bool update_ride_index()
+{
+	SdFile index_file;
+	ride_index_entry_struct entry;
+
+	if (!index_file.open(RIDE_INDEX_FILENAME, O_RDWR))
+	{
+		return 0;
+	}
+	fill_ride_index_entry(&entry);
+
+	bool status = index_file.seekSet(ride_index_pos) && index_file.write(&entry, sizeof(entry)) == sizeof(entry);
+	index_file.close();
+	return status;
+}
+
+#ifdef ENABLE_HISTORY_DISPLAY
+// Reads the newest HISTORY_RIDES entries of the index into entries, returns their number
+// Called by the SPI bus task with the bus taken
+byte load_ride_history(ride_index_entry_struct *entries)
+{
+	SdFile index_file;
+	byte count = 0;
+
+	if (!index_file.open(RIDE_INDEX_FILENAME, O_RDONLY))
+	{
+		return 0;
+	}
+	uint32_t position = index_file.fileSize() / RIDE_INDEX_ENTRY_SIZE;
+	while (position > 0 && count < HISTORY_RIDES)
+	{
+		position--;
+		ride_index_entry_struct *entry = &entries[count];
+		if (!index_file.seekSet(position * RIDE_INDEX_ENTRY_SIZE) || index_file.read(entry, sizeof(ride_index_entry_struct)) != sizeof(ride_index_entry_struct))
+		{
+			break;
+		}
+		if (entry->magic == RIDE_INDEX_MAGIC)
+		{
+			count++;
+		}
+	}
+	index_file.close();
+	return count;
+}
+#endif
+
 void set_filename()
 {
 	// Set Filename
@@ -1682,37 +3855,26 @@ void set_filename()
 	unsigned int filename_length = filename.length() + 1;
 	// fileName[filename_length];
 	filename.toCharArray(fileName, filename_length);
-#ifdef DEBUG
-	Serial.print("filename_length: ");
-	Serial.println(filename_length);
-	Serial.print("fileName: ");
-	Serial.println(fileName);
-#endif // DEBUG
+	LOG_DEBUG(LOG_ID_SD_FILE_NAME, filename_length - 1);
 }
 
 bool SD_set_timestamps()
 {
 	bool status = 1;
-	RtcDateTime now_temp = Rtc.GetDateTime();
+	RtcDateTime now_temp = clock_now();
 	if (!file.timestamp(T_CREATE, now_temp.Year(), now_temp.Month(), now_temp.Day(), now_temp.Hour(), now_temp.Minute(), now_temp.Second()))
 	{
-#ifdef DEBUG
-		Serial.println("set create time failed");
-#endif // DEBUG
+		LOG_WARN(LOG_ID_SD_TIMESTAMP, 0);
 		status = 0;
 	}
 	if (!file.timestamp(T_WRITE, now_temp.Year(), now_temp.Month(), now_temp.Day(), now_temp.Hour(), now_temp.Minute(), now_temp.Second()))
 	{
-#ifdef DEBUG
-		Serial.println("set write time failed");
-#endif // DEBUG
+		LOG_WARN(LOG_ID_SD_TIMESTAMP, 1);
 		status = 0;
 	}
 	if (!file.timestamp(T_ACCESS, now_temp.Year(), now_temp.Month(), now_temp.Day(), now_temp.Hour(), now_temp.Minute(), now_temp.Second()))
 	{
-#ifdef DEBUG
-		Serial.println("set access time failed");
-#endif // DEBUG
+		LOG_WARN(LOG_ID_SD_TIMESTAMP, 2);
 		status = 0;
 	}
 	return status;
@@ -1720,7 +3882,7 @@ bool SD_set_timestamps()
 
 String time_comb_helper(bool include_day, bool include_date, bool include_time, bool time_separator)
 {
-	RtcDateTime now = Rtc.GetDateTime();
+	RtcDateTime now = clock_now();
 	String t_c;
 	String hour_padding = zero_padder(String(now.Hour()));	 // Add Padding to Hours
 	String min_padding = zero_padder(String(now.Minute()));	 // Add Padding to Minutes
@@ -1759,3 +3921,300 @@ String time_comb_helper(bool include_day, bool include_date, bool include_time,
 
 // END SD
 /////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////////////////
+// CHECKPOINT
+/*
+Crash-safe logging: the trip state and the log position are saved to RTC memory.
+After a reset the tail of the log is validated with the chunk CRC and the ride continues in the same file.
+*/
+void save_checkpoint()
+{
+	portENTER_CRITICAL(&checkpoint_mux);
+	checkpoint.magic = CHECKPOINT_MAGIC;
+	checkpoint.version = CHECKPOINT_VERSION;
+
+	checkpoint.travel_distance_km = gps_data.travel_distance_km;
+	checkpoint.last_lat = gps_data.last_lat;
+	checkpoint.last_lng = gps_data.last_lng;
+	checkpoint.avg_speed = stats.avg_speed;
+	checkpoint.ride_max_speed = stats.ride_max_speed;
+	checkpoint.moving_time = stats.moving_time;
+	checkpoint.seconds_running = seconds_running;
+	checkpoint.climb = climb;
+
+	checkpoint.crc = log_crc32(0, &checkpoint, offsetof(checkpoint_struct, crc));
+	portEXIT_CRITICAL(&checkpoint_mux);
+}
+
+// Saves the log file and position, called by the SPI bus task after every write
+// and by init_sd_logger() once the first chunk header is written
+void save_log_position()
+{
+	portENTER_CRITICAL(&checkpoint_mux);
+	checkpoint.log_valid = 1;
+	strncpy(checkpoint.file_name, fileName, sizeof(checkpoint.file_name));
+	checkpoint.ride_index_pos = ride_index_pos;
+	checkpoint.ride_start_time = ride_start_time;
+	checkpoint.log_chunk = log_chunk;
+
+	checkpoint.crc = log_crc32(0, &checkpoint, offsetof(checkpoint_struct, crc));
+	portEXIT_CRITICAL(&checkpoint_mux);
+}
+
+// Invalidates the log file of the checkpoint while a new one is created
+void clear_log_position()
+{
+	portENTER_CRITICAL(&checkpoint_mux);
+	checkpoint.log_valid = 0;
+	memset(checkpoint.file_name, 0, sizeof(checkpoint.file_name));
+	checkpoint.ride_index_pos = 0;
+	checkpoint.ride_start_time = 0;
+	memset(&checkpoint.log_chunk, 0, sizeof(checkpoint.log_chunk));
+
+	checkpoint.crc = log_crc32(0, &checkpoint, offsetof(checkpoint_struct, crc));
+	portEXIT_CRITICAL(&checkpoint_mux);
+}
+
+// Restores the trip state, returns false if there is no valid checkpoint
+bool load_checkpoint()
+{
+	esp_reset_reason_t reason = esp_reset_reason();
+
+	// RTC memory is random after a power cycle
+	if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN)
+	{
+		return 0;
+	}
+	if (checkpoint.magic != CHECKPOINT_MAGIC || checkpoint.version != CHECKPOINT_VERSION || checkpoint.crc != log_crc32(0, &checkpoint, offsetof(checkpoint_struct, crc)))
+	{
+		return 0;
+	}
+
+	gps_data.travel_distance_km = checkpoint.travel_distance_km;
+	stats.avg_speed = checkpoint.avg_speed;
+	stats.ride_max_speed = checkpoint.ride_max_speed;
+	stats.moving_time = checkpoint.moving_time;
+	seconds_running = checkpoint.seconds_running;
+	climb = checkpoint.climb;
+
+	// Continue measuring from the last known position
+	// (the mapper path itself is too large for RTC memory and starts again from here)
+	if (checkpoint.last_lat != 0 || checkpoint.last_lng != 0)
+	{
+		gps_data.startup = 1;
+		gps_data.last_lat = checkpoint.last_lat;
+		gps_data.last_lng = checkpoint.last_lng;
+		mapper.last_lat = checkpoint.last_lat;
+		mapper.last_lng = checkpoint.last_lng;
+	}
+
+#ifdef DEBUG
+	Serial.printf("Checkpoint restored (reset reason %i, %.2lfkm)\n", reason, gps_data.travel_distance_km);
+#endif // DEBUG
+	return 1;
+}
+
+// Reopens the log file of the checkpoint and validates its tail
+// Returns false if the file can't be continued (a new one has to be started)
+bool resume_sd_logger()
+{
+	if (!checkpoint.log_valid)
+	{ // Reset before the first chunk header of the file was written
+		return 0;
+	}
+	const log_chunk_struct *c = &checkpoint.log_chunk;
+	uint32_t data_pos = c->index * LOG_CHUNK_SIZE + LOG_CHUNK_HEADER_SIZE;
+
+	strncpy(fileName, checkpoint.file_name, sizeof(fileName));
+	fileName[sizeof(fileName) - 1] = '\0';
+	if (!file.open(fileName, O_RDWR))
+	{
+		return 0;
+	}
+
+	// Check the data of the current chunk up to the checkpoint
+	bool valid = file.fileSize() >= data_pos + c->length && file.seekSet(data_pos);
+	uint32_t crc = 0;
+	uint32_t remaining = c->length;
+	char buffer[256];
+	while (valid && remaining > 0)
+	{
+		int n = file.read(buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+		if (n <= 0)
+		{
+			valid = 0;
+			break;
+		}
+		crc = log_crc32(crc, buffer, n);
+		remaining -= n;
+	}
+	if (!valid || crc != c->crc)
+	{
+#ifdef DEBUG
+		Serial.println("Log tail doesn't match the checkpoint!");
+#endif // DEBUG
+		file.close();
+		return 0;
+	}
+
+	// Drop whatever was written after the checkpoint (a partial row) and continue
+	log_chunk = checkpoint.log_chunk;
+	ride_index_pos = checkpoint.ride_index_pos;
+	ride_start_time = checkpoint.ride_start_time;
+	bool status = file.truncate(data_pos + c->length);
+	status &= sd_write_chunk_header();
+	file.flush();
+	if (!continue_ride_index())
+	{
+		LOG_ERROR(LOG_ID_SD_RIDE_INDEX);
+	}
+#ifdef ENABLE_TRACK_COMPRESSION
+	if (!track_open(1))
+	{
+		LOG_ERROR(LOG_ID_SD_OPEN);
+	}
+#endif
+	return status;
+}
+
+// Puts the fixes that weren't written before the reset into the backlog, the SD supervisor writes them first
+// The ring is only continued together with the ride (the log file of the checkpoint)
+void rtc_track_restore()
+{
+	if (!ride_resumed || !rtc_track_valid(&rtc_track))
+	{
+		rtc_track_init(&rtc_track, TRACK_LZ);
+		return;
+	}
+
+	uint32_t lost;
+	int count = rtc_track_recover(&rtc_track, rtc_track_restore_fix, NULL, &lost);
+	if (count > 0 || lost > 0)
+	{
+		LOG_INFO(LOG_ID_RTC_TRACK, count, lost);
+	}
+}
+
+void rtc_track_restore_fix(const track_fix_struct *fix, uint32_t seq, void *context)
+{
+	log_record_struct record;
+	record.time = fix->value[TRACK_TIME];
+	record.lat = track_fix_get(fix, TRACK_LAT);
+	record.lng = track_fix_get(fix, TRACK_LNG);
+	record.distance_km = track_fix_get(fix, TRACK_DISTANCE);
+	record.seq = seq;
+#ifdef ENABLE_TRACK_COMPRESSION
+	record.fix = *fix;
+#endif
+	int length = track_format_row(fix, UTC_ADJ * 3600, record.row, sizeof(record.row));
+	record.length = length < (int)sizeof(record.row) ? length : sizeof(record.row) - 1;
+
+	portENTER_CRITICAL(&backlog_mux);
+	backlog_push(&record);
+	portEXIT_CRITICAL(&backlog_mux);
+}
+
+// END CHECKPOINT
+/////////////////////////////////////////////////////////////////////////
+
+#ifdef ENABLE_PARKING
+/////////////////////////////////////////////////////////////////////////
+// PARKING
+/*
+Deep sleep while the bike is parked.
+The ESP32 draws ~10uA in deep sleep and the GPS keeps its ephemeris and time in backup mode,
+so after the wake-up it has a fix again within a few seconds (hot start).
+A button press (ext0) wakes the computer up, setup() restores the trip from RTC memory and draws the
+speed screen right away. The timer wakes it up every PARK_WAKE_INTERVAL seconds with the display off:
+if the bike moves within PARK_CHECK_TIME the ride just continues, otherwise it goes back to sleep.
+*/
+
+// Called in every loop, goes to deep sleep once the motion state is parked
+// There is no timer of its own, so the display and the deep sleep always agree on "parked"
+void park_update()
+{
+	if (motion_moving(&motion))
+	{
+		park_activity();
+	}
+	if (motion.state == MOTION_PARKED)
+	{
+		park_enter();
+	}
+}
+
+// Movement or a button press, restarts the park time of the motion state
+// Returns true if the display was off (after a timer wake-up) and has been turned on
+bool park_activity()
+{
+	motion_hold(&motion, millis());
+	if (!park_check)
+	{
+		return 0;
+	}
+	park_check = 0;
+	motion.park_time = MOTION_PARK_TIME;
+	xSemaphoreTake(spi_mutex, portMAX_DELAY);
+	u8g2.setPowerSave(0);
+	xSemaphoreGive(spi_mutex);
+	return 1;
+}
+
+// Syncs the log, turns the display, the backlight and the GPS off and starts the deep sleep
+// This function doesn't return, the wake-up is a reset
+void park_enter()
+{
+	LOG_INFO(LOG_ID_PARK, (millis() - motion.state_since + motion.park_time) / 1000);
+	save_checkpoint();
+#if defined(ENABLE_GPS_AIDING) && defined(ENABLE_PREFERENCES)
+	if (gps_aiding_valid(&gps_aiding))
+	{ // The RTC memory is lost if the battery runs empty while parked
+		gps_aiding_store();
+	}
+#endif
+
+	// The bus task writes all queued rows first, rows that don't make it are still in the RTC track
+	sd_submit(SPI_SD_PARK, NULL);
+	if (xSemaphoreTake(park_ready, pdMS_TO_TICKS(PARK_SYNC_TIMEOUT)) != pdTRUE)
+	{
+		LOG_WARN(LOG_ID_PARK_SYNC);
+	}
+
+	// The pads aren't driven in deep sleep, so the backlight pin is held low
+	ledc_stop(LEDC_HIGH_SPEED_MODE, (ledc_channel_t)ledChannel, 0);
+	gpio_hold_en((gpio_num_t)backlight_pin);
+	gpio_deep_sleep_hold_en();
+
+	gps_backup();
+
+	// The pull-up of the button has to be an RTC one to work in deep sleep
+	rtc_gpio_pullup_en((gpio_num_t)button_pin);
+	esp_sleep_enable_ext0_wakeup((gpio_num_t)button_pin, 0);
+	esp_sleep_enable_timer_wakeup(PARK_WAKE_INTERVAL * 1000000ULL);
+
+	// Give the debug log a chance to print the last messages
+	vTaskDelay(pdMS_TO_TICKS(2 * DEBUG_LOG_INTERVAL));
+	Serial.flush();
+	esp_deep_sleep_start();
+}
+
+// Puts the GPS into backup mode until gps_wake() (UBX-RXM-PMREQ)
+void gps_backup()
+{
+	ubx_rxm_pmreq_struct request = {0, UBX_PMREQ_BACKUP}; // Until woken up
+	uint8_t frame[UBX_OVERHEAD + sizeof(request)];
+	Serial2.write(frame, ubx_frame(UBX_CLASS_RXM, UBX_RXM_PMREQ, &request, sizeof(request), frame, sizeof(frame)));
+	Serial2.flush();
+}
+
+// Any activity on its RX line wakes the GPS up from backup mode, these bytes are lost
+void gps_wake()
+{
+	const uint8_t wake[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+	Serial2.write(wake, sizeof(wake));
+}
+
+// END PARKING
+/////////////////////////////////////////////////////////////////////////
+#endif
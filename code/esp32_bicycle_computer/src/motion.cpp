@@ -0,0 +1,141 @@
+/*
+   Motion
+   See motion.h
+ */
+
+#include "motion.h"
+#include "geodesic.h"
+
+void motion_init(motion_struct *m, double speed_stop, double speed_move, double speed_hyst, double hdop_good, double hdop_bad, double radius,
+				 uint32_t stop_time, uint32_t still_time, uint32_t park_time, uint32_t time)
+{
+	m->speed_stop = speed_stop;
+	m->speed_move = speed_move;
+	m->speed_hyst = speed_hyst;
+	m->hdop_good = hdop_good;
+	m->hdop_bad = hdop_bad;
+	m->radius = radius;
+	m->stop_time = stop_time;
+	m->still_time = still_time;
+	m->park_time = park_time;
+
+	m->state = MOTION_STOPPED;
+	m->state_since = time;
+	m->good = 0;
+	m->anchor_set = 0;
+	m->anchor_lat = 0;
+	m->anchor_lng = 0;
+	m->displaced_time = time;
+	m->below_stop = 0;
+	m->below_stop_since = time;
+	m->spread = 0;
+	m->changes = 0;
+}
+
+static void motion_set(motion_struct *m, uint8_t state, uint32_t time)
+{
+	if (m->state != state)
+	{
+		m->state = state;
+		m->state_since = time;
+		m->changes++;
+	}
+}
+
+static void motion_anchor(motion_struct *m, double lat, double lng, uint32_t time)
+{
+	m->anchor_set = 1;
+	m->anchor_lat = lat;
+	m->anchor_lng = lng;
+	m->displaced_time = time;
+}
+
+uint8_t motion_tick(motion_struct *m, uint32_t time)
+{
+	if (motion_moving(m))
+	{
+		if ((m->below_stop && time - m->below_stop_since >= m->stop_time) || time - m->displaced_time >= m->still_time)
+		{
+			motion_set(m, MOTION_STOPPED, time);
+		}
+	}
+	else if (m->state == MOTION_STOPPED && time - m->state_since >= m->park_time)
+	{
+		motion_set(m, MOTION_PARKED, time);
+	}
+	return m->state;
+}
+
+void motion_hold(motion_struct *m, uint32_t time)
+{
+	if (!motion_moving(m))
+	{
+		motion_set(m, MOTION_STOPPED, time);
+		m->state_since = time;
+	}
+}
+
+uint8_t motion_update(motion_struct *m, uint32_t time, double lat, double lng, double speed, double hdop)
+{
+	if (hdop <= m->hdop_good)
+	{
+		m->good = 1;
+	}
+	else if (hdop > m->hdop_bad)
+	{
+		m->good = 0;
+	}
+	if (!m->good)
+	{
+		return motion_tick(m, time);
+	}
+
+	if (!m->anchor_set)
+	{
+		motion_anchor(m, lat, lng, time);
+	}
+	m->spread = geo_equirectangular_m(m->anchor_lat, m->anchor_lng, lat, lng);
+	bool displaced = m->spread > m->radius;
+
+	if (speed < m->speed_stop)
+	{
+		if (!m->below_stop)
+		{
+			m->below_stop = 1;
+			m->below_stop_since = time;
+		}
+	}
+	else
+	{
+		m->below_stop = 0;
+	}
+
+	if (motion_moving(m))
+	{
+		if (displaced)
+		{ // The anchor follows in radius steps
+			motion_anchor(m, lat, lng, time);
+		}
+		if (speed >= m->speed_move)
+		{
+			motion_set(m, MOTION_MOVING, time);
+		}
+		else if (m->state == MOTION_MOVING && speed < m->speed_move - m->speed_hyst)
+		{
+			motion_set(m, MOTION_SLOW, time);
+		}
+	}
+	else if (displaced && speed >= m->speed_stop + m->speed_hyst)
+	{ // Left the radius around the stop position with a plausible speed
+		motion_anchor(m, lat, lng, time);
+		motion_set(m, speed >= m->speed_move ? MOTION_MOVING : MOTION_SLOW, time);
+	}
+
+	bool moving = motion_moving(m);
+	motion_tick(m, time);
+	if (moving && !motion_moving(m))
+	{ // Just stopped, the jitter is measured from here
+		motion_anchor(m, lat, lng, time);
+	}
+	return m->state;
+}
@@ -0,0 +1,124 @@
+/*
+   RTC Track
+   See rtc_track.h
+ */
+
+#include "rtc_track.h"
+#include "log_chunk.h" // log_crc32()
+
+#include <stddef.h>
+#include <string.h>
+
+static uint32_t rtc_track_crc(const rtc_track_struct *t)
+{
+	return log_crc32(0, t, offsetof(rtc_track_struct, crc));
+}
+
+void rtc_track_init(rtc_track_struct *t, bool lz)
+{
+	memset(t, 0, sizeof(rtc_track_struct));
+	t->magic = RTC_TRACK_MAGIC;
+	track_encoder_init(&t->encoder, lz);
+	t->crc = rtc_track_crc(t);
+}
+
+bool rtc_track_valid(const rtc_track_struct *t)
+{
+	return t->magic == RTC_TRACK_MAGIC && t->crc == rtc_track_crc(t) && t->persisted_seq <= t->next_seq &&
+		   t->current_seq <= t->next_seq && t->encoder.length <= TRACK_BLOCK_PAYLOAD;
+}
+
+uint32_t rtc_track_add(rtc_track_struct *t, const track_fix_struct *fix)
+{
+	uint32_t seq = t->next_seq;
+	if (!track_encoder_add(&t->encoder, fix))
+	{ // Move the full block into the ring, this overwrites the oldest one
+		uint32_t slot = t->finished % RTC_TRACK_BLOCKS;
+		memcpy(t->blocks[slot], track_encoder_block(&t->encoder), TRACK_BLOCK_SIZE);
+		t->first_seq[slot] = t->current_seq;
+		t->finished++;
+		track_encoder_next_block(&t->encoder);
+		t->current_seq = seq;
+		track_encoder_add(&t->encoder, fix);
+	}
+
+	// Keep the header and the CRC of the current block valid, a reset can happen any time
+	track_encoder_block(&t->encoder);
+	t->next_seq++;
+	t->crc = rtc_track_crc(t);
+	return seq;
+}
+
+void rtc_track_persisted(rtc_track_struct *t, uint32_t seq)
+{
+	if (seq + 1 > t->persisted_seq)
+	{
+		t->persisted_seq = seq + 1;
+	}
+}
+
+struct rtc_track_recover_struct
+{
+	uint32_t first_seq;
+	uint32_t persisted_seq;
+	rtc_track_callback function;
+	void *context;
+	int count;
+};
+
+static void rtc_track_recover_fix(const track_fix_struct *fix, int index, void *context)
+{
+	rtc_track_recover_struct *r = (rtc_track_recover_struct *)context;
+	uint32_t seq = r->first_seq + index;
+	if (seq >= r->persisted_seq)
+	{
+		r->function(fix, seq, r->context);
+		r->count++;
+	}
+}
+
+int rtc_track_recover(const rtc_track_struct *t, rtc_track_callback function, void *context, uint32_t *lost)
+{
+	rtc_track_recover_struct r = {0, t->persisted_seq, function, context, 0};
+	*lost = 0;
+
+	// Finished blocks (oldest first), then the current one
+	uint32_t oldest = t->finished > RTC_TRACK_BLOCKS ? t->finished - RTC_TRACK_BLOCKS : 0;
+	uint32_t oldest_seq = t->finished > 0 ? t->first_seq[oldest % RTC_TRACK_BLOCKS] : t->current_seq;
+	if (r.persisted_seq < oldest_seq)
+	{ // Overwritten before they were persisted
+		*lost += oldest_seq - r.persisted_seq;
+		r.persisted_seq = oldest_seq;
+	}
+	for (uint32_t block = oldest; block <= t->finished; block++)
+	{
+		const uint8_t *data;
+		uint32_t end_seq;
+		if (block < t->finished)
+		{
+			data = t->blocks[block % RTC_TRACK_BLOCKS];
+			r.first_seq = t->first_seq[block % RTC_TRACK_BLOCKS];
+			end_seq = block + 1 < t->finished ? t->first_seq[(block + 1) % RTC_TRACK_BLOCKS] : t->current_seq;
+		}
+		else if (t->encoder.fixes > 0)
+		{
+			data = t->encoder.block;
+			r.first_seq = t->current_seq;
+			end_seq = t->next_seq;
+		}
+		else
+		{
+			break;
+		}
+		if (end_seq <= r.persisted_seq)
+		{
+			continue;
+		}
+
+		if (track_decode_block_each(data, rtc_track_recover_fix, &r) < 0)
+		{ // Damaged (e.g. reset while the block was written)
+			*lost += end_seq - (r.first_seq > r.persisted_seq ? r.first_seq : r.persisted_seq);
+		}
+	}
+	return r.count;
+}
@@ -0,0 +1,110 @@
+/*
+   Telemetry
+   See telemetry.h
+ */
+
+#include "telemetry.h"
+#include "log_chunk.h"
+#include <string.h>
+
+size_t cobs_encode(const uint8_t *data, size_t length, uint8_t *out)
+{
+	size_t code_pos = 0; // Position of the current code byte
+	size_t pos = 1;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		if (data[i] == 0)
+		{
+			out[code_pos] = code;
+			code_pos = pos++;
+			code = 1;
+		}
+		else
+		{
+			out[pos++] = data[i];
+			code++;
+			if (code == 0xFF)
+			{ // Block of 254 non-zero bytes
+				out[code_pos] = code;
+				code_pos = pos++;
+				code = 1;
+			}
+		}
+	}
+	out[code_pos] = code;
+	return pos;
+}
+
+size_t cobs_decode(const uint8_t *data, size_t length, uint8_t *out, size_t out_size)
+{
+	size_t pos = 0;
+	size_t out_pos = 0;
+
+	while (pos < length)
+	{
+		uint8_t code = data[pos++];
+		if (code == 0 || pos + code - 1 > length)
+		{
+			return 0;
+		}
+		for (uint8_t i = 1; i < code; i++)
+		{
+			if (data[pos] == 0 || out_pos >= out_size)
+			{
+				return 0;
+			}
+			out[out_pos++] = data[pos++];
+		}
+		// A code below 0xFF stands for a zero byte, except at the end
+		if (code < 0xFF && pos < length)
+		{
+			if (out_pos >= out_size)
+			{
+				return 0;
+			}
+			out[out_pos++] = 0;
+		}
+	}
+	return out_pos;
+}
+
+size_t telemetry_frame(uint8_t type, const void *payload, size_t length, uint8_t *out)
+{
+	uint8_t raw[1 + TELEMETRY_MAX_PAYLOAD + 4];
+
+	if (length > TELEMETRY_MAX_PAYLOAD)
+	{
+		return 0;
+	}
+	raw[0] = type;
+	memcpy(raw + 1, payload, length);
+	uint32_t crc = log_crc32(0, raw, 1 + length);
+	memcpy(raw + 1 + length, &crc, 4);
+
+	out[0] = 0;
+	size_t encoded = cobs_encode(raw, 1 + length + 4, out + 1);
+	out[1 + encoded] = 0;
+	return encoded + 2;
+}
+
+int telemetry_parse(const uint8_t *frame, size_t length, uint8_t *type, uint8_t *payload)
+{
+	uint8_t raw[1 + TELEMETRY_MAX_PAYLOAD + 4];
+
+	size_t decoded = cobs_decode(frame, length, raw, sizeof(raw));
+	if (decoded < 5)
+	{
+		return -1;
+	}
+	uint32_t crc;
+	memcpy(&crc, raw + decoded - 4, 4);
+	if (crc != log_crc32(0, raw, decoded - 4))
+	{
+		return -1;
+	}
+	*type = raw[0];
+	memcpy(payload, raw + 1, decoded - 5);
+	return decoded - 5;
+}
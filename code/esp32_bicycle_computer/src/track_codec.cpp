@@ -0,0 +1,392 @@
+/*
+   Track Codec
+   See track_codec.h
+ */
+
+#include "track_codec.h"
+#include "log_chunk.h" // log_crc32()
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRACK_VARINT_MAX 10 // 64 bit
+#define TRACK_RAW_MAX (TRACK_FIELDS * TRACK_VARINT_MAX)
+#define TRACK_LZ_MIN_MATCH 3
+#define TRACK_LZ_MAX_MATCH (0x7F + TRACK_LZ_MIN_MATCH)
+#define TRACK_LZ_MAX_LITERALS 0x80
+
+// Precision of the CSV columns (see sd_format_row())
+const double track_field_scale[TRACK_FIELDS] = {1, 1e7, 1e7, 1000, 1, 100, 100, 1, 100, 10, 10, 10, 10, 100};
+
+// Fields that change steadily while moving are predicted linearly
+static const bool track_field_linear[TRACK_FIELDS] = {true, true, true, false, false, false, false, false, true, false, false, false, false, false};
+
+void track_fix_set(track_fix_struct *fix, track_field_enum field, double value)
+{
+	double scaled = value * track_field_scale[field];
+	if (isnan(scaled) || scaled < -2147483647.0 || scaled > 2147483647.0)
+	{
+		fix->value[field] = TRACK_NAN;
+		return;
+	}
+	fix->value[field] = (int32_t)lround(scaled);
+}
+
+double track_fix_get(const track_fix_struct *fix, track_field_enum field)
+{
+	if (fix->value[field] == TRACK_NAN)
+	{
+		return NAN;
+	}
+	return fix->value[field] / track_field_scale[field];
+}
+
+// Prediction of a field from the previous fixes of the block
+static int64_t track_predict(const int32_t *last, const int64_t *last_step, int field)
+{
+	return track_field_linear[field] ? (int64_t)last[field] + last_step[field] : last[field];
+}
+
+static int track_put_varint(uint8_t *out, int64_t value)
+{
+	uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	int length = 0;
+	while (zigzag >= 0x80)
+	{
+		out[length++] = (uint8_t)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	out[length++] = (uint8_t)zigzag;
+	return length;
+}
+
+static void track_put_u16(uint8_t *p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static void track_put_u32(uint8_t *p, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		p[i] = value >> (8 * i);
+	}
+}
+
+static uint16_t track_get_u16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t track_get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Greedy LZ77 of raw against the window (and itself), returns the number of bytes written to out
+// Token < 0x80: (token + 1) literals follow, otherwise a match of (token & 0x7F) + 3 bytes, distance - 1 follows
+static int track_lz_encode(const track_encoder_struct *e, const uint8_t *raw, int raw_length, uint8_t *out)
+{
+	uint8_t buffer[TRACK_LZ_WINDOW + TRACK_RAW_MAX];
+	int history = e->window_length < TRACK_LZ_WINDOW ? e->window_length : TRACK_LZ_WINDOW;
+	for (int i = 0; i < history; i++)
+	{
+		buffer[i] = e->window[(e->window_length - history + i) % TRACK_LZ_WINDOW];
+	}
+	memcpy(buffer + history, raw, raw_length);
+
+	int end = history + raw_length;
+	int length = 0;
+	int literals = 0; // Position of the pending literal run in out
+	int literal_count = 0;
+	for (int p = history; p < end;)
+	{
+		int best_length = 0;
+		int best_distance = 0;
+		int max_distance = p < TRACK_LZ_WINDOW ? p : TRACK_LZ_WINDOW;
+		for (int distance = 1; distance <= max_distance; distance++)
+		{
+			int n = 0;
+			while (p + n < end && n < TRACK_LZ_MAX_MATCH && buffer[p + n - distance] == buffer[p + n])
+			{
+				n++;
+			}
+			if (n > best_length)
+			{
+				best_length = n;
+				best_distance = distance;
+			}
+		}
+
+		if (best_length >= TRACK_LZ_MIN_MATCH)
+		{
+			out[length++] = 0x80 | (best_length - TRACK_LZ_MIN_MATCH);
+			out[length++] = best_distance - 1;
+			literal_count = 0;
+			p += best_length;
+			continue;
+		}
+
+		if (literal_count == 0 || literal_count == TRACK_LZ_MAX_LITERALS)
+		{
+			literals = length++;
+			literal_count = 0;
+		}
+		out[literals] = literal_count++;
+		out[length++] = buffer[p++];
+	}
+	return length;
+}
+
+void track_encoder_init(track_encoder_struct *e, bool lz)
+{
+	e->flags = lz ? TRACK_FLAG_LZ : 0;
+	track_encoder_next_block(e);
+}
+
+void track_encoder_next_block(track_encoder_struct *e)
+{
+	memset(e->block, 0, sizeof(e->block));
+	memset(e->last, 0, sizeof(e->last));
+	memset(e->last_step, 0, sizeof(e->last_step));
+	e->length = 0;
+	e->fixes = 0;
+	e->window_length = 0;
+}
+
+bool track_encoder_add(track_encoder_struct *e, const track_fix_struct *fix)
+{
+	uint8_t raw[TRACK_RAW_MAX];
+	int raw_length = 0;
+	for (int i = 0; i < TRACK_FIELDS; i++)
+	{
+		raw_length += track_put_varint(raw + raw_length, fix->value[i] - track_predict(e->last, e->last_step, i));
+	}
+
+	uint8_t lz[TRACK_RAW_MAX + TRACK_RAW_MAX / TRACK_LZ_MAX_LITERALS + 1];
+	const uint8_t *out = raw;
+	int length = raw_length;
+	if (e->flags & TRACK_FLAG_LZ)
+	{
+		length = track_lz_encode(e, raw, raw_length, lz);
+		out = lz;
+	}
+	if (e->length + length > TRACK_BLOCK_PAYLOAD)
+	{
+		return false;
+	}
+
+	memcpy(e->block + TRACK_BLOCK_HEADER_SIZE + e->length, out, length);
+	e->length += length;
+	for (int i = 0; i < raw_length; i++)
+	{
+		e->window[e->window_length++ % TRACK_LZ_WINDOW] = raw[i];
+	}
+	for (int i = 0; i < TRACK_FIELDS; i++)
+	{
+		// The first fix of a block has no step
+		e->last_step[i] = e->fixes == 0 ? 0 : (int64_t)fix->value[i] - e->last[i];
+		e->last[i] = fix->value[i];
+	}
+	if (e->fixes == 0)
+	{
+		track_put_u32(e->block + 8, fix->value[TRACK_TIME]);
+	}
+	e->fixes++;
+	return true;
+}
+
+const uint8_t *track_encoder_block(track_encoder_struct *e)
+{
+	uint8_t *header = e->block;
+	header[0] = 'T';
+	header[1] = 'K';
+	header[2] = TRACK_VERSION;
+	header[3] = e->flags;
+	track_put_u16(header + 4, e->fixes);
+	track_put_u16(header + 6, e->length);
+	track_put_u32(header + 12, log_crc32(0, e->block + TRACK_BLOCK_HEADER_SIZE, e->length));
+	return e->block;
+}
+
+// Reads the bytes before the LZ stage
+struct track_decoder_struct
+{
+	const uint8_t *payload;
+	int position;
+	int length;
+	bool lz;
+	int literals; // Left in the current token
+	int match;
+	int distance;
+	uint8_t window[TRACK_LZ_WINDOW];
+	uint32_t window_length;
+};
+
+// Returns the next byte or -1 at the end of the payload / for an invalid token
+static int track_next_byte(track_decoder_struct *d)
+{
+	if (!d->lz)
+	{
+		return d->position < d->length ? d->payload[d->position++] : -1;
+	}
+
+	if (d->literals == 0 && d->match == 0)
+	{
+		if (d->position >= d->length)
+		{
+			return -1;
+		}
+		uint8_t token = d->payload[d->position++];
+		if (token < 0x80)
+		{
+			d->literals = token + 1;
+		}
+		else
+		{
+			if (d->position >= d->length)
+			{
+				return -1;
+			}
+			d->match = (token & 0x7F) + TRACK_LZ_MIN_MATCH;
+			d->distance = d->payload[d->position++] + 1;
+			if ((uint32_t)d->distance > d->window_length)
+			{
+				return -1;
+			}
+		}
+	}
+
+	uint8_t value;
+	if (d->match > 0)
+	{
+		value = d->window[(d->window_length - d->distance) % TRACK_LZ_WINDOW];
+		d->match--;
+	}
+	else
+	{
+		if (d->position >= d->length)
+		{
+			return -1;
+		}
+		value = d->payload[d->position++];
+		d->literals--;
+	}
+	d->window[d->window_length++ % TRACK_LZ_WINDOW] = value;
+	return value;
+}
+
+static bool track_get_varint(track_decoder_struct *d, int64_t *value)
+{
+	uint64_t zigzag = 0;
+	for (int i = 0; i < TRACK_VARINT_MAX; i++)
+	{
+		int b = track_next_byte(d);
+		if (b < 0)
+		{
+			return false;
+		}
+		zigzag |= (uint64_t)(b & 0x7F) << (7 * i);
+		if (b < 0x80)
+		{
+			*value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+int track_decode_block_each(const uint8_t *block, track_fix_callback function, void *context)
+{
+	if (block[0] != 'T' || block[1] != 'K' || block[2] != TRACK_VERSION)
+	{
+		return -1;
+	}
+	int count = track_get_u16(block + 4);
+	int length = track_get_u16(block + 6);
+	if (count == 0 || count > TRACK_BLOCK_MAX_FIXES || length > TRACK_BLOCK_PAYLOAD ||
+		log_crc32(0, block + TRACK_BLOCK_HEADER_SIZE, length) != track_get_u32(block + 12))
+	{
+		return -1;
+	}
+
+	track_decoder_struct d;
+	memset(&d, 0, sizeof(d));
+	d.payload = block + TRACK_BLOCK_HEADER_SIZE;
+	d.length = length;
+	d.lz = block[3] & TRACK_FLAG_LZ;
+
+	track_fix_struct fix;
+	int64_t last_step[TRACK_FIELDS] = {0};
+	memset(&fix, 0, sizeof(fix));
+	for (int n = 0; n < count; n++)
+	{
+		for (int i = 0; i < TRACK_FIELDS; i++)
+		{
+			int64_t residual;
+			if (!track_get_varint(&d, &residual))
+			{
+				return -1;
+			}
+			int32_t last = fix.value[i];
+			fix.value[i] = (int32_t)(track_predict(fix.value, last_step, i) + residual);
+			last_step[i] = n == 0 ? 0 : (int64_t)fix.value[i] - last;
+		}
+		function(&fix, n, context);
+	}
+	return count;
+}
+
+struct track_decode_array_struct
+{
+	track_fix_struct *fixes;
+	int max_fixes;
+};
+
+static void track_store_fix(const track_fix_struct *fix, int index, void *context)
+{
+	track_decode_array_struct *array = (track_decode_array_struct *)context;
+	if (index < array->max_fixes)
+	{
+		array->fixes[index] = *fix;
+	}
+}
+
+int track_decode_block(const uint8_t *block, track_fix_struct *fixes, int max_fixes)
+{
+	if (block[0] == 'T' && block[1] == 'K' && track_get_u16(block + 4) > max_fixes)
+	{
+		return -1;
+	}
+	track_decode_array_struct array = {fixes, max_fixes};
+	return track_decode_block_each(block, track_store_fix, &array);
+}
+
+// Temperature and humidity are empty fields while the sensor is starting (TRACK_NAN)
+static void track_format_sensor(const track_fix_struct *fix, track_field_enum field, char *text, size_t size)
+{
+	if (fix->value[field] == TRACK_NAN)
+	{
+		text[0] = '\0';
+		return;
+	}
+	snprintf(text, size, "%5.2f", track_fix_get(fix, field));
+}
+
+int track_format_row(const track_fix_struct *fix, long utc_offset_s, char *row, size_t size)
+{
+	long day_seconds = ((fix->value[TRACK_TIME] - utc_offset_s) % 86400 + 86400) % 86400;
+	char temperature[16], humidity[16];
+	track_format_sensor(fix, TRACK_TEMPERATURE, temperature, sizeof(temperature));
+	track_format_sensor(fix, TRACK_HUMIDITY, humidity, sizeof(humidity));
+	return snprintf(row, size, "%10.7lf,%10.7lf,%i:%i:%i,%6.3f,%i,%s,%s,%i,%5.2f,%.1f,%.1f,%.1f,%.1f,%.2f,\n",
+					track_fix_get(fix, TRACK_LAT), track_fix_get(fix, TRACK_LNG),
+					(int)(day_seconds / 3600), (int)(day_seconds / 60 % 60), (int)(day_seconds % 60),
+					track_fix_get(fix, TRACK_SPEED), (int)fix->value[TRACK_SATELLITES],
+					temperature, humidity, (int)fix->value[TRACK_LIGHT],
+					track_fix_get(fix, TRACK_DISTANCE), track_fix_get(fix, TRACK_ALTITUDE),
+					track_fix_get(fix, TRACK_ASCENT), track_fix_get(fix, TRACK_DESCENT), track_fix_get(fix, TRACK_GRADE),
+					track_fix_get(fix, TRACK_BATTERY));
+}
@@ -0,0 +1,122 @@
+/*
+   UBX
+   See ubx.h
+ */
+
+#include "ubx.h"
+#include <string.h>
+
+enum ubx_parser_state_enum
+{
+	UBX_STATE_SYNC_1,
+	UBX_STATE_SYNC_2,
+	UBX_STATE_CLASS,
+	UBX_STATE_ID,
+	UBX_STATE_LENGTH_1,
+	UBX_STATE_LENGTH_2,
+	UBX_STATE_PAYLOAD,
+	UBX_STATE_CHECKSUM_1,
+	UBX_STATE_CHECKSUM_2
+};
+
+static void ubx_checksum_add(uint8_t *checksum, const uint8_t *data, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		checksum[0] += data[i];
+		checksum[1] += checksum[0];
+	}
+}
+
+size_t ubx_frame(uint8_t message_class, uint8_t id, const void *payload, uint16_t length, uint8_t *out, size_t size)
+{
+	if (size < (size_t)UBX_OVERHEAD + length)
+	{
+		return 0;
+	}
+	out[0] = UBX_SYNC_1;
+	out[1] = UBX_SYNC_2;
+	out[2] = message_class;
+	out[3] = id;
+	out[4] = length & 0xFF;
+	out[5] = length >> 8;
+	memcpy(out + 6, payload, length);
+
+	uint8_t checksum[2] = {0, 0};
+	ubx_checksum_add(checksum, out + 2, 4 + length);
+	out[6 + length] = checksum[0];
+	out[7 + length] = checksum[1];
+	return UBX_OVERHEAD + length;
+}
+
+void ubx_parser_init(ubx_parser_struct *p)
+{
+	memset(p, 0, sizeof(ubx_parser_struct));
+}
+
+bool ubx_parse(ubx_parser_struct *p, uint8_t byte)
+{
+	switch (p->state)
+	{
+	case UBX_STATE_SYNC_1:
+		if (byte == UBX_SYNC_1)
+		{
+			p->state = UBX_STATE_SYNC_2;
+		}
+		return 0;
+	case UBX_STATE_SYNC_2:
+		p->state = byte == UBX_SYNC_2 ? UBX_STATE_CLASS : (byte == UBX_SYNC_1 ? UBX_STATE_SYNC_2 : UBX_STATE_SYNC_1);
+		p->checksum[0] = p->checksum[1] = 0;
+		return 0;
+	case UBX_STATE_CLASS:
+		p->message_class = byte;
+		p->state = UBX_STATE_ID;
+		break;
+	case UBX_STATE_ID:
+		p->id = byte;
+		p->state = UBX_STATE_LENGTH_1;
+		break;
+	case UBX_STATE_LENGTH_1:
+		p->length = byte;
+		p->state = UBX_STATE_LENGTH_2;
+		break;
+	case UBX_STATE_LENGTH_2:
+		p->length |= byte << 8;
+		p->index = 0;
+		if (p->length > UBX_MAX_PAYLOAD)
+		{ // Can't be checked, start looking for the next frame
+			p->failed_checksum++;
+			p->state = UBX_STATE_SYNC_1;
+			return 0;
+		}
+		p->state = p->length > 0 ? UBX_STATE_PAYLOAD : UBX_STATE_CHECKSUM_1;
+		break;
+	case UBX_STATE_PAYLOAD:
+		p->payload[p->index++] = byte;
+		if (p->index >= p->length)
+		{
+			p->state = UBX_STATE_CHECKSUM_1;
+		}
+		break;
+	case UBX_STATE_CHECKSUM_1:
+		p->state = byte == p->checksum[0] ? UBX_STATE_CHECKSUM_2 : UBX_STATE_SYNC_1;
+		if (p->state == UBX_STATE_SYNC_1)
+		{
+			p->failed_checksum++;
+		}
+		return 0;
+	case UBX_STATE_CHECKSUM_2:
+		p->state = UBX_STATE_SYNC_1;
+		if (byte != p->checksum[1])
+		{
+			p->failed_checksum++;
+			return 0;
+		}
+		p->frames++;
+		return 1;
+	}
+
+	// Class, id, length and payload are covered by the checksum
+	ubx_checksum_add(p->checksum, &byte, 1);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+   Battery Trace
+   Feeds a recorded or synthetic trace of reference ADC readings through the firmware's
+   battery monitor and prints the filtered voltage, state of charge and runtime estimation.
+
+   Usage: battery_trace <trace file>     (one "<ms>,<ADC reading>" per line)
+          battery_trace --synthetic      (discharge to empty with ADC noise, see synthetic())
+          battery_trace --check          (the synthetic discharge, returns 1 if the runtime
+                                          estimate near empty is off by more than CHECK_MAX_ERROR)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bicycle_computer_config.h"
+#include "battery_monitor.h"
+
+// Synthetic discharge: the load doubles below SYNTHETIC_STEP_SOC (e.g. the light is switched on)
+#define SYNTHETIC_START_SOC 96.0
+#define SYNTHETIC_STEP_SOC 20.0
+#define SYNTHETIC_RATE 10.0		 // %/h
+#define SYNTHETIC_RATE_LOW 20.0 // %/h
+
+// The estimate is checked below SYNTHETIC_STEP_SOC, after the rate had CHECK_SETTLE ms to follow the step
+#define CHECK_SETTLE (2 * BATTERY_RATE_WINDOW)
+#define CHECK_MAX_ERROR 0.15 // h
+
+static battery_struct battery;
+static uint32_t next_print = 0;
+static bool print = true;
+
+static void process(uint32_t ms, double ref_reading)
+{
+	double raw = battery_voltage_from_reference(ref_reading, REF_VOLTAGE / REF_ADJ);
+	battery_update(&battery, raw, ms);
+
+	// Print once per minute
+	if (print && ms >= next_print)
+	{
+		printf("%7.1f min  raw %.3fV  filtered %.3fV  %5.1f%%  rate %5.1f%%/h  runtime %5.2fh\n",
+			   ms / 60000.0, raw, battery.voltage, battery.soc, battery.rate, battery.runtime_h);
+		next_print = ms + 60000;
+	}
+}
+
+// Reading of the reference for a given supply voltage
+static double reference_reading(double voltage)
+{
+	return 4095.0 * (REF_VOLTAGE / REF_ADJ) / voltage;
+}
+
+// Voltage of a state of charge (inverse of battery_soc())
+static double soc_voltage(double soc)
+{
+	double low = 3.0, high = 4.3;
+	for (int i = 0; i < 40; i++)
+	{
+		double mid = (low + high) / 2;
+		if (battery_soc(mid) < soc)
+			low = mid;
+		else
+			high = mid;
+	}
+	return (low + high) / 2;
+}
+
+// Discharges a battery that follows the discharge curve to empty, with +-20 counts of noise on every
+// ADC reading. Returns the largest runtime error (h) near empty.
+static double synthetic()
+{
+	const double step_h = (SYNTHETIC_START_SOC - SYNTHETIC_STEP_SOC) / SYNTHETIC_RATE;
+	const double empty_h = step_h + SYNTHETIC_STEP_SOC / SYNTHETIC_RATE_LOW;
+	double max_error = 0;
+
+	srand(1);
+	for (uint32_t ms = 0; ms < empty_h * 3600000; ms += BATTERY_SAMPLE_INTERVAL)
+	{
+		double h = ms / 3600000.0;
+		double soc = h < step_h ? SYNTHETIC_START_SOC - SYNTHETIC_RATE * h : SYNTHETIC_RATE_LOW * (empty_h - h);
+		double voltage = soc_voltage(soc);
+		double sum = 0;
+		for (int i = 0; i < BATTERY_OVERSAMPLING; i++)
+		{
+			sum += floor(reference_reading(voltage) + (rand() % 41 - 20));
+		}
+		process(ms, sum / BATTERY_OVERSAMPLING);
+
+		if (h >= step_h + CHECK_SETTLE / 3600000.0)
+		{
+			double error = fabs(battery.runtime_h - (empty_h - h));
+			max_error = error > max_error ? error : max_error;
+		}
+	}
+	return max_error;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <trace file> | --synthetic | --check\n", argv[0]);
+		return 1;
+	}
+
+	battery_init(&battery, BATTERY_FILTER, BATTERY_NOMINAL_RUNTIME, BATTERY_RATE_WINDOW);
+
+	if (strcmp(argv[1], "--synthetic") == 0)
+	{
+		synthetic();
+		return 0;
+	}
+	if (strcmp(argv[1], "--check") == 0)
+	{
+		print = false;
+		double max_error = synthetic();
+		printf("max. runtime error below %.0f%%: %.2fh (limit %.2fh)\n", SYNTHETIC_STEP_SOC, max_error, CHECK_MAX_ERROR);
+		return max_error > CHECK_MAX_ERROR ? 1 : 0;
+	}
+
+	FILE *f = fopen(argv[1], "r");
+	if (!f)
+	{
+		fprintf(stderr, "%s: can't open file\n", argv[1]);
+		return 1;
+	}
+	unsigned long ms;
+	double reading;
+	char line[128];
+	while (fgets(line, sizeof(line), f))
+	{
+		if (sscanf(line, "%lu,%lf", &ms, &reading) == 2)
+		{
+			process(ms, reading);
+		}
+	}
+	fclose(f);
+	return 0;
+}
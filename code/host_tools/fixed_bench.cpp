@@ -0,0 +1,193 @@
+/*
+   Fixed Bench
+   Compares the fixed point formatter of the firmware (see fixed_format.h) with snprintf:
+   every value has to give the same text byte for byte, then both are timed.
+
+   Usage: fixed_bench [values]      (default 2000000)
+   Returns 1 if a text differs.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "fixed_format.h"
+
+// The formats used by the firmware
+struct format_struct
+{
+	const char *name;
+	uint8_t decimals;
+	uint8_t width;
+	uint8_t flags;
+	double min, max; // Range of the random values
+};
+
+static const format_struct formats[] = {
+	{"%10.7f", 7, 10, 0, -180, 180}, // Latitude / longitude
+	{"%6.3f", 3, 6, 0, 0, 80},		 // Speed
+	{"%5.2f", 2, 5, 0, -40, 100},	 // Temperature, humidity, distance
+	{"%.2f", 2, 0, 0, 0, 2000},		 // Speed, altitude
+	{"%.1f", 1, 0, 0, -500, 5000},	 // Altitude, ascent, battery
+	{"%.0f", 0, 0, 0, -100, 100},	 // Grade, temperature
+	{"%+.0f", 0, 0, FIXED_PLUS, -30, 30},
+	{"%.4f", 4, 0, 0, -180, 180},
+	{"%.9f", 9, 0, 0, -1e6, 1e6},
+};
+
+static unsigned long mismatches = 0;
+
+static void check(const format_struct *f, double value)
+{
+	char expected[512], text[512];
+	char format[16];
+	snprintf(format, sizeof(format), "%%%s*.*f", (f->flags & FIXED_PLUS) ? "+" : "");
+	snprintf(expected, sizeof(expected), format, f->width, f->decimals, value);
+	fixed_format(text, sizeof(text), value, f->decimals, f->width, f->flags);
+	if (strcmp(text, expected) != 0 && mismatches++ < 10)
+		printf("%s of %.17g: \"%s\" instead of \"%s\"\n", f->name, value, text, expected);
+}
+
+// Random values, exact ties, the neighbours of ties and special values
+static std::vector<double> test_values(const format_struct *f, size_t count, std::mt19937_64 *rng)
+{
+	std::uniform_real_distribution<double> uniform(f->min, f->max);
+	std::vector<double> values;
+	double scale = pow(10, f->decimals);
+	for (size_t i = 0; i < count; i++)
+	{
+		double value = uniform(*rng);
+		switch (i % 4)
+		{
+		case 0:
+			values.push_back(value);
+			break;
+		case 1: // Printed values of the CSV (already rounded)
+			values.push_back(round(value * scale) / scale);
+			break;
+		default: // Around the middle between two printed values
+		{
+			double tie = (floor(value * scale) + 0.5) / scale;
+			values.push_back(i % 4 == 2 ? nextafter(tie, -INFINITY) : nextafter(tie, INFINITY));
+			values.push_back(tie);
+		}
+		}
+	}
+	const double special[] = {0.0, -0.0, 0.5, -0.5, 1.5, 2.5, 0.125, 0.375, -0.001, 1e-300, -1e-300, 5e-324, 9.999999949999,
+							  1e18, -1e18, 9.2e18, 1e300, -1e300, INFINITY, -INFINITY, NAN};
+	values.insert(values.end(), special, special + sizeof(special) / sizeof(special[0]));
+	return values;
+}
+
+template <typename F>
+static double ns_per_call(F function, size_t calls)
+{
+	auto start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / calls * 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+	std::mt19937_64 rng(1);
+	volatile size_t sink = 0;
+
+	for (const format_struct &f : formats)
+	{
+		std::vector<double> values = test_values(&f, count, &rng);
+		for (double value : values)
+			check(&f, value);
+
+		char text[64];
+		char format[16];
+		snprintf(format, sizeof(format), "%%%s*.*f", (f.flags & FIXED_PLUS) ? "+" : "");
+		double t_printf = ns_per_call([&]() {
+			for (double value : values)
+				sink += snprintf(text, sizeof(text), format, f.width, f.decimals, value);
+		}, values.size());
+		double t_fixed = ns_per_call([&]() {
+			for (double value : values)
+				sink += fixed_format(text, sizeof(text), value, f.decimals, f.width, f.flags);
+		}, values.size());
+		printf("%-7s %9zu values  snprintf %6.1fns  fixed %6.1fns  (x%.1f)\n", f.name, values.size(), t_printf, t_fixed, t_printf / t_fixed);
+	}
+
+	// A whole CSV row like sd_format_row()
+	std::uniform_real_distribution<double> uniform(0, 1);
+	std::vector<double> rows(count / 10 * 14);
+	for (double &value : rows)
+		value = uniform(rng) * 100;
+	size_t row_count = rows.size() / 14;
+	char row[160], expected[160];
+	for (size_t i = 0; i < row_count; i++)
+	{
+		const double *v = &rows[i * 14];
+		snprintf(expected, sizeof(expected), "%10.7lf,%10.7lf,%i:%i:%i,%6.3f,%i,%5.2f,%5.2f,%i,%5.2f,%.1f,%.1f,%.1f,%.1f,%.2f,\n",
+				 v[0], v[1], 12, 3, 4, v[3], 9, v[5], v[6], 800, v[8], v[9], v[10], v[11], v[12], v[13]);
+		fixed_writer_struct w;
+		fixed_writer_init(&w, row, sizeof(row));
+		fixed_append_double(&w, v[0], 7, 10, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_double(&w, v[1], 7, 10, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_int(&w, 12, 0, 0);
+		fixed_append_char(&w, ':');
+		fixed_append_int(&w, 3, 0, 0);
+		fixed_append_char(&w, ':');
+		fixed_append_int(&w, 4, 0, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_double(&w, v[3], 3, 6, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_int(&w, 9, 0, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_double(&w, v[5], 2, 5, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_double(&w, v[6], 2, 5, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_int(&w, 800, 0, 0);
+		fixed_append_char(&w, ',');
+		fixed_append_double(&w, v[8], 2, 5, 0);
+		for (int j = 9; j < 13; j++)
+		{
+			fixed_append_char(&w, ',');
+			fixed_append_double(&w, v[j], 1, 0, 0);
+		}
+		fixed_append_char(&w, ',');
+		fixed_append_double(&w, v[13], 2, 0, 0);
+		fixed_append_text(&w, ",\n");
+		if (strcmp(row, expected) != 0 && mismatches++ < 10)
+			printf("Row \"%s\" instead of \"%s\"\n", row, expected);
+	}
+	double t_printf = ns_per_call([&]() {
+		for (size_t i = 0; i < row_count; i++)
+		{
+			const double *v = &rows[i * 14];
+			sink += snprintf(expected, sizeof(expected), "%10.7lf,%10.7lf,%i:%i:%i,%6.3f,%i,%5.2f,%5.2f,%i,%5.2f,%.1f,%.1f,%.1f,%.1f,%.2f,\n",
+							 v[0], v[1], 12, 3, 4, v[3], 9, v[5], v[6], 800, v[8], v[9], v[10], v[11], v[12], v[13]);
+		}
+	}, row_count);
+	double t_fixed = ns_per_call([&]() {
+		for (size_t i = 0; i < row_count; i++)
+		{
+			const double *v = &rows[i * 14];
+			fixed_writer_struct w;
+			fixed_writer_init(&w, row, sizeof(row));
+			for (int j = 0; j < 14; j++)
+			{
+				fixed_append_double(&w, v[j], j < 2 ? 7 : 2, j < 2 ? 10 : 5, 0);
+				fixed_append_char(&w, ',');
+			}
+			sink += w.length;
+		}
+	}, row_count);
+	printf("CSV row %9zu rows    snprintf %6.1fns  fixed %6.1fns  (x%.1f)\n", row_count, t_printf, t_fixed, t_printf / t_fixed);
+
+	printf(mismatches ? "%lu texts differ!\n" : "All texts are identical\n", mismatches);
+	return mismatches ? 1 : 0;
+}
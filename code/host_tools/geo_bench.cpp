@@ -0,0 +1,148 @@
+/*
+   Geo Bench
+   Checks that the batched (vectorisable) geodesic kernels agree with the scalar ones used by
+   the firmware (see geodesic.h) and measures both.
+
+   Usage: geo_bench [points]      (default 4000000)
+   Returns 1 if a batched result differs by more than the tolerance.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "geodesic.h"
+
+#define DISTANCE_TOLERANCE_M 1e-3 // Batched vs. scalar
+#define DISTANCE_TOLERANCE 1e-8	  // Relative, for almost antipodal points asin() is ill-conditioned
+#define BEARING_TOLERANCE_DEG 1e-6
+
+struct points_struct
+{
+	std::vector<double> lat1, lng1, lat2, lng2;
+};
+
+// Pairs like a logged track (a few meters apart) or anywhere on the earth
+static void generate(points_struct *p, size_t n, bool track, unsigned seed)
+{
+	std::mt19937_64 rng(seed);
+	std::uniform_real_distribution<double> lat(-89.9, 89.9), lng(-180, 180), step(-0.0005, 0.0005);
+	p->lat1.resize(n);
+	p->lng1.resize(n);
+	p->lat2.resize(n);
+	p->lng2.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		p->lat1[i] = lat(rng);
+		p->lng1[i] = lng(rng);
+		p->lat2[i] = track ? p->lat1[i] + step(rng) : lat(rng);
+		p->lng2[i] = track ? p->lng1[i] + step(rng) : lng(rng);
+	}
+}
+
+template <typename F>
+static double seconds(F function)
+{
+	auto start = std::chrono::steady_clock::now();
+	function();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool check(const char *name, const points_struct &p, size_t n)
+{
+	std::vector<double> scalar(n), batch(n);
+	bool ok = true;
+
+	// Haversine
+	double t_scalar = seconds([&]() {
+		for (size_t i = 0; i < n; i++)
+			scalar[i] = geo_haversine_m(p.lat1[i], p.lng1[i], p.lat2[i], p.lng2[i]);
+	});
+	double t_batch = seconds([&]() { geo_haversine_batch(p.lat1.data(), p.lng1.data(), p.lat2.data(), p.lng2.data(), batch.data(), n); });
+	double max_error = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		double error = fabs(scalar[i] - batch[i]);
+		ok &= error <= fmax(DISTANCE_TOLERANCE_M, DISTANCE_TOLERANCE * scalar[i]);
+		max_error = fmax(max_error, error);
+	}
+	printf("%-6s haversine        scalar %7.1fM/s  batch %7.1fM/s  (x%.1f)  max. difference %.3gm\n", name,
+		   n / t_scalar / 1e6, n / t_batch / 1e6, t_scalar / t_batch, max_error);
+
+	// Equirectangular (and how far it is from the great circle)
+	std::vector<double> haversine = scalar;
+	t_scalar = seconds([&]() {
+		for (size_t i = 0; i < n; i++)
+			scalar[i] = geo_equirectangular_m(p.lat1[i], p.lng1[i], p.lat2[i], p.lng2[i]);
+	});
+	t_batch = seconds([&]() { geo_equirectangular_batch(p.lat1.data(), p.lng1.data(), p.lat2.data(), p.lng2.data(), batch.data(), n); });
+	max_error = 0;
+	double max_approximation = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		max_error = fmax(max_error, fabs(scalar[i] - batch[i]));
+		if (haversine[i] > 1)
+			max_approximation = fmax(max_approximation, fabs(scalar[i] - haversine[i]) / haversine[i]);
+	}
+	ok &= max_error <= DISTANCE_TOLERANCE_M;
+	printf("%-6s equirectangular  scalar %7.1fM/s  batch %7.1fM/s  (x%.1f)  max. difference %.3gm, vs. haversine %.3g%%\n", name,
+		   n / t_scalar / 1e6, n / t_batch / 1e6, t_scalar / t_batch, max_error, max_approximation * 100);
+
+	// Bearing
+	t_scalar = seconds([&]() {
+		for (size_t i = 0; i < n; i++)
+			scalar[i] = geo_bearing_deg(p.lat1[i], p.lng1[i], p.lat2[i], p.lng2[i]);
+	});
+	t_batch = seconds([&]() { geo_bearing_batch(p.lat1.data(), p.lng1.data(), p.lat2.data(), p.lng2.data(), batch.data(), n); });
+	max_error = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		double difference = fabs(scalar[i] - batch[i]);
+		max_error = fmax(max_error, fmin(difference, 360 - difference));
+	}
+	ok &= max_error <= BEARING_TOLERANCE_DEG;
+	printf("%-6s bearing          scalar %7.1fM/s  batch %7.1fM/s  (x%.1f)  max. difference %.3g deg\n", name,
+		   n / t_scalar / 1e6, n / t_batch / 1e6, t_scalar / t_batch, max_error);
+
+	// ENU projection (the same arithmetic, has to match exactly)
+	geo_enu_struct enu;
+	geo_enu_init(&enu, p.lat1[0], p.lng1[0]);
+	std::vector<double> north(n), batch_north(n);
+	t_scalar = seconds([&]() {
+		for (size_t i = 0; i < n; i++)
+			geo_enu_project(&enu, p.lat2[i], p.lng2[i], &scalar[i], &north[i]);
+	});
+	t_batch = seconds([&]() { geo_enu_project_batch(&enu, p.lat2.data(), p.lng2.data(), batch.data(), batch_north.data(), n); });
+	max_error = 0;
+	for (size_t i = 0; i < n; i++)
+		max_error = fmax(max_error, fmax(fabs(scalar[i] - batch[i]), fabs(north[i] - batch_north[i])));
+	ok &= max_error == 0;
+	printf("%-6s enu              scalar %7.1fM/s  batch %7.1fM/s  (x%.1f)  max. difference %.3gm\n", name,
+		   n / t_scalar / 1e6, n / t_batch / 1e6, t_scalar / t_batch, max_error);
+
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+	if (n == 0)
+	{
+		fprintf(stderr, "Usage: %s [points]\n", argv[0]);
+		return 1;
+	}
+
+	points_struct points;
+	bool ok = true;
+	generate(&points, n, true, 1);
+	ok &= check("track", points, n);
+	generate(&points, n, false, 2);
+	ok &= check("global", points, n);
+
+	printf(ok ? "Batched kernels agree with the scalar ones\n" : "Batched kernels differ from the scalar ones!\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,318 @@
+/*
+   GPS Sim
+   A simulated u-blox receiver for the GPS aiding of the firmware (see gps_aiding.h and ubx.h).
+   The receiver parses the bytes the firmware sends over Serial2 (mixed with NMEA text, stray sync bytes and
+   cut off frames to check the resynchronisation of the parser), applies UBX-MGA-INI-POS_LLH / TIME_UTC and goes into backup mode on UBX-RXM-PMREQ (parking).
+
+   Checks:
+   - the saved fix and the clock arrive in the receiver with the right values and accuracies
+   - the date conversion against gmtime() for every day of 2000..2135
+   - no time is sent with a clock before the saved fix, nothing with a damaged saved fix
+   - damaged frames are rejected
+   - the parking sequence: backup, wake-up by RX activity (the first bytes are lost), aiding
+
+   Usage: gps_sim [cases]      (default 100000)
+   Returns 1 if a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <random>
+#include <vector>
+
+#include "gps_aiding.h"
+#include "ubx.h"
+
+#define EPOCH_2000 946684800 // 01.01.2000 in Unix time
+#define SIM_WAKE_BYTES 4	 // Bytes the receiver loses while it wakes up from backup mode
+
+struct sim_receiver_struct
+{
+	ubx_parser_struct parser;
+	bool backup;
+	int wake_bytes; // Still to be dropped
+	bool has_pos, has_time;
+	ubx_mga_ini_pos_llh_struct pos;
+	ubx_mga_ini_time_utc_struct utc;
+	unsigned long unknown; // Frames the receiver would NAK
+};
+
+static void sim_init(sim_receiver_struct *r)
+{
+	memset(r, 0, sizeof(sim_receiver_struct));
+	ubx_parser_init(&r->parser);
+}
+
+static void sim_frame(sim_receiver_struct *r)
+{
+	const ubx_parser_struct *p = &r->parser;
+	if (p->message_class == UBX_CLASS_MGA && p->id == UBX_MGA_INI && p->length == sizeof(r->pos) && p->payload[0] == UBX_MGA_INI_POS_LLH)
+	{
+		memcpy(&r->pos, p->payload, sizeof(r->pos));
+		r->has_pos = 1;
+	}
+	else if (p->message_class == UBX_CLASS_MGA && p->id == UBX_MGA_INI && p->length == sizeof(r->utc) && p->payload[0] == UBX_MGA_INI_TIME_UTC)
+	{
+		memcpy(&r->utc, p->payload, sizeof(r->utc));
+		r->has_time = 1;
+	}
+	else if (p->message_class == UBX_CLASS_RXM && p->id == UBX_RXM_PMREQ && p->length == sizeof(ubx_rxm_pmreq_struct))
+	{
+		ubx_rxm_pmreq_struct request;
+		memcpy(&request, p->payload, sizeof(request));
+		r->backup = (request.flags & UBX_PMREQ_BACKUP) != 0;
+	}
+	else
+	{
+		r->unknown++;
+	}
+}
+
+static void sim_receive(sim_receiver_struct *r, const uint8_t *data, size_t length)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		if (r->backup)
+		{ // Any activity on RX wakes it up, the bytes until it runs are lost
+			r->backup = 0;
+			r->wake_bytes = SIM_WAKE_BYTES;
+		}
+		if (r->wake_bytes > 0)
+		{
+			r->wake_bytes--;
+			continue;
+		}
+		if (ubx_parse(&r->parser, data[i]))
+		{
+			sim_frame(r);
+		}
+	}
+}
+
+static unsigned long failures = 0;
+
+#define CHECK(condition, ...)                  \
+	do                                         \
+	{                                          \
+		if (!(condition) && failures++ < 10)   \
+		{                                      \
+			printf(__VA_ARGS__);               \
+			printf("\n");                      \
+		}                                      \
+	} while (0)
+
+// Bytes besides the frames: NMEA sentences, UBX sync bytes and cut off frames
+static void add_noise(std::vector<uint8_t> *line, std::mt19937_64 *rng)
+{
+	static const char *nmea = "$GPRMC,101200.00,A,4807.03812,N,01131.00012,E,0.004,,010619,,,A*71\r\n";
+	switch ((*rng)() % 4)
+	{
+	case 0:
+		line->insert(line->end(), nmea, nmea + strlen(nmea));
+		break;
+	case 1:
+		line->push_back(UBX_SYNC_1);
+		break;
+	case 2: // Sync, class and id, the checksum fails somewhere in the NMEA text
+		line->push_back(UBX_SYNC_1);
+		line->push_back(UBX_SYNC_2);
+		line->push_back(UBX_CLASS_MGA);
+		line->push_back(UBX_MGA_INI);
+		line->push_back(2);
+		line->push_back(0);
+		line->insert(line->end(), nmea, nmea + strlen(nmea));
+		break;
+	default:
+		break;
+	}
+}
+
+// Sends the line in random pieces like the UART
+static void send_pieces(sim_receiver_struct *r, const std::vector<uint8_t> &line, std::mt19937_64 *rng)
+{
+	size_t pos = 0;
+	while (pos < line.size())
+	{
+		size_t n = 1 + (*rng)() % 40;
+		n = n < line.size() - pos ? n : line.size() - pos;
+		sim_receive(r, line.data() + pos, n);
+		pos += n;
+	}
+}
+
+// Every day from 2000 to 2135 (uint32_t seconds since 2000) against gmtime()
+static void check_dates()
+{
+	for (uint64_t day = 0; day * 86400 + 86399 <= UINT32_MAX; day++)
+	{
+		uint32_t time = day * 86400 + (day * 7919) % 86400;
+		uint16_t year;
+		uint8_t month, d, hour, minute, second;
+		gps_aiding_date(time, &year, &month, &d, &hour, &minute, &second);
+		time_t unix = (time_t)time + EPOCH_2000;
+		struct tm tm;
+		gmtime_r(&unix, &tm);
+		CHECK(year == tm.tm_year + 1900 && month == tm.tm_mon + 1 && d == tm.tm_mday && hour == tm.tm_hour && minute == tm.tm_min && second == tm.tm_sec,
+			  "Date of %u: %04u-%02u-%02u %02u:%02u:%02u instead of %04i-%02i-%02i %02i:%02i:%02i", time, year, month, d, hour, minute, second,
+			  tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+	}
+}
+
+// Random saved fixes and clocks, sent through a noisy line
+static void check_aiding(size_t cases, std::mt19937_64 *rng)
+{
+	std::uniform_real_distribution<double> lat_dist(-90, 90), lng_dist(-180, 180), alt_dist(-400, 8000), hdop_dist(0.5, 20), margin_dist(0, 5000);
+	std::uniform_int_distribution<uint32_t> time_dist(1000, 3000000000u), age_dist(0, 100000000), ms_dist(0, 999);
+	size_t time_cases = 0;
+
+	for (size_t i = 0; i < cases; i++)
+	{
+		double lat = lat_dist(*rng), lng = lng_dist(*rng), alt = alt_dist(*rng), hdop = hdop_dist(*rng), margin = margin_dist(*rng);
+		uint32_t fix_time = time_dist(*rng);
+		bool clock_valid = i % 8 != 0;
+		uint32_t now = clock_valid ? fix_time + age_dist(*rng) : fix_time - 1 - (*rng)() % 1000;
+		uint16_t now_ms = ms_dist(*rng);
+
+		gps_aiding_struct a;
+		gps_aiding_set(&a, lat, lng, alt, fix_time, hdop, 7);
+		uint8_t frames[GPS_AIDING_MAX_FRAMES_SIZE];
+		size_t length = gps_aiding_frames(&a, now, now_ms, margin, frames, sizeof(frames));
+
+		std::vector<uint8_t> line;
+		add_noise(&line, rng);
+		line.insert(line.end(), frames, frames + length);
+		add_noise(&line, rng);
+		sim_receiver_struct r;
+		sim_init(&r);
+		send_pieces(&r, line, rng);
+
+		CHECK(r.has_pos, "Case %zu: position not received", i);
+		CHECK(r.has_time == clock_valid, "Case %zu: time %s", i, clock_valid ? "not received" : "received with a clock before the fix");
+		CHECK(r.unknown == 0, "Case %zu: %lu unknown frames", i, r.unknown);
+		if (r.has_pos)
+		{
+			double accuracy = lround(hdop * 100) / 100.0 * GPS_AIDING_UERE + margin;
+			CHECK(r.pos.lat == lround(lat * 1e7) && r.pos.lon == lround(lng * 1e7) && r.pos.alt == lround(alt * 100), "Case %zu: position %i %i %i", i,
+				  r.pos.lat, r.pos.lon, r.pos.alt);
+			CHECK(fabs(r.pos.pos_acc - accuracy * 100) <= 1, "Case %zu: position accuracy %ucm instead of %.0lfcm", i, r.pos.pos_acc, accuracy * 100);
+		}
+		if (r.has_time && clock_valid)
+		{
+			time_cases++;
+			time_t unix = (time_t)now + EPOCH_2000;
+			struct tm tm;
+			gmtime_r(&unix, &tm);
+			CHECK(r.utc.year == tm.tm_year + 1900 && r.utc.month == tm.tm_mon + 1 && r.utc.day == tm.tm_mday && r.utc.hour == tm.tm_hour &&
+					  r.utc.minute == tm.tm_min && r.utc.second == tm.tm_sec && r.utc.ns == now_ms * 1000000u,
+				  "Case %zu: wrong time", i);
+			CHECK(r.utc.leap_secs == -128 && r.utc.ref == 0, "Case %zu: wrong time reference", i);
+			double t_acc = 1.0 + (now - fix_time) * GPS_AIDING_RTC_PPM * 1e-6;
+			double sent = r.utc.t_acc_s + r.utc.t_acc_ns * 1e-9;
+			CHECK(sent >= t_acc - 1e-12 && sent - t_acc < 2e-9 && r.utc.t_acc_ns < 1000000000u, "Case %zu: time accuracy %.9lfs instead of %.9lfs", i, sent, t_acc);
+		}
+	}
+	printf("Aiding: %zu cases (%zu with time) through a noisy line\n", cases, time_cases);
+}
+
+// A saved fix from random RTC memory and damaged frames
+static void check_damage(std::mt19937_64 *rng)
+{
+	gps_aiding_struct a;
+	gps_aiding_set(&a, 48.1173, 11.5167, 520, 613000000, 0.9, 9);
+	uint8_t frames[GPS_AIDING_MAX_FRAMES_SIZE];
+	size_t length = gps_aiding_frames(&a, 613000100, 0, 2000, frames, sizeof(frames));
+	CHECK(length == GPS_AIDING_MAX_FRAMES_SIZE, "Frames have %zu bytes instead of %zu", length, (size_t)GPS_AIDING_MAX_FRAMES_SIZE);
+
+	// Every bit of the saved fix
+	for (size_t bit = 0; bit < offsetof(gps_aiding_struct, crc) * 8; bit++)
+	{
+		gps_aiding_struct damaged = a;
+		((uint8_t *)&damaged)[bit / 8] ^= 1 << (bit % 8);
+		CHECK(gps_aiding_frames(&damaged, 613000100, 0, 2000, frames, sizeof(frames)) == 0, "Damaged saved fix (bit %zu) was sent", bit);
+	}
+	gps_aiding_struct random;
+	for (int i = 0; i < 10000; i++)
+	{
+		for (size_t j = 0; j < sizeof(random); j++)
+			((uint8_t *)&random)[j] = (*rng)() & 0xFF;
+		CHECK(!gps_aiding_valid(&random), "Random RTC memory is a valid saved fix");
+	}
+
+	// Every byte of the frames
+	length = gps_aiding_frames(&a, 613000100, 0, 2000, frames, sizeof(frames));
+	unsigned long rejected = 0;
+	for (size_t i = 2; i < length; i++)
+	{
+		uint8_t damaged[GPS_AIDING_MAX_FRAMES_SIZE];
+		memcpy(damaged, frames, length);
+		damaged[i] ^= 1 << ((*rng)() % 8);
+		sim_receiver_struct r;
+		sim_init(&r);
+		sim_receive(&r, damaged, length);
+		// The damaged frame is dropped (a wrong length can take the other one with it)
+		size_t first_length = UBX_OVERHEAD + sizeof(ubx_mga_ini_pos_llh_struct);
+		CHECK(!(i < first_length ? r.has_pos : r.has_time), "Damaged byte %zu: frame accepted", i);
+		CHECK(!r.has_pos || memcmp(&r.pos, frames + 6, sizeof(r.pos)) == 0, "Damaged byte %zu: wrong position", i);
+		CHECK(!r.has_time || memcmp(&r.utc, frames + first_length + 6, sizeof(r.utc)) == 0, "Damaged byte %zu: wrong time", i);
+		rejected += r.parser.failed_checksum;
+	}
+	printf("Damage: %zu bits of the saved fix, 10000 random RTC memories, %zu damaged frames (%lu rejected by the checksum)\n",
+		   offsetof(gps_aiding_struct, crc) * 8, length - 2, rejected);
+}
+
+// park_enter(): backup mode, the wake-up bytes of gps_wake(), then the aiding of the next boot
+static void check_parking()
+{
+	sim_receiver_struct r;
+	sim_init(&r);
+	ubx_rxm_pmreq_struct request = {0, UBX_PMREQ_BACKUP};
+	uint8_t frame[UBX_OVERHEAD + sizeof(request)];
+	sim_receive(&r, frame, ubx_frame(UBX_CLASS_RXM, UBX_RXM_PMREQ, &request, sizeof(request), frame, sizeof(frame)));
+	CHECK(r.backup, "Receiver not in backup mode after UBX-RXM-PMREQ");
+
+	gps_aiding_struct a;
+	gps_aiding_set(&a, -33.8568, 151.2153, 12, 700000000, 1.2, 11);
+	uint8_t frames[GPS_AIDING_MAX_FRAMES_SIZE];
+	size_t length = gps_aiding_frames(&a, 700003600, 250, 2000, frames, sizeof(frames));
+
+	// Without the wake-up bytes the first frame is lost
+	sim_receiver_struct lost = r;
+	sim_receive(&lost, frames, length);
+	CHECK(!lost.has_pos, "Position received while the receiver was waking up");
+
+	const uint8_t wake[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+	sim_receive(&r, wake, sizeof(wake));
+	CHECK(!r.backup, "Receiver still in backup mode");
+	sim_receive(&r, frames, length);
+	CHECK(r.has_pos && r.has_time && r.unknown == 0, "Aiding after the wake-up not received");
+	printf("Parking: backup, wake-up and aiding\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t cases = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+	std::mt19937_64 rng(1);
+
+	// A frame to compare with the u-blox documentation (or u-center)
+	gps_aiding_struct a;
+	gps_aiding_set(&a, 48.1173, 11.5167, 520, 613000000, 0.9, 9);
+	uint8_t frames[GPS_AIDING_MAX_FRAMES_SIZE];
+	size_t length = gps_aiding_frames(&a, 613000100, 500, 2000, frames, sizeof(frames));
+	printf("Aiding frames (%zu bytes):", length);
+	for (size_t i = 0; i < length; i++)
+		printf("%s%02X", i == UBX_OVERHEAD + sizeof(ubx_mga_ini_pos_llh_struct) ? "\n  " : " ", frames[i]);
+	printf("\n");
+
+	check_dates();
+	printf("Dates: every day of 2000..2135\n");
+	check_aiding(cases, &rng);
+	check_damage(&rng);
+	check_parking();
+
+	printf(failures ? "%lu checks failed!\n" : "All checks passed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+/*
+   Log Decimate
+   Replays full-rate logs (GPS_Data_*.csv written without ENABLE_LOG_DECIMATION) through the
+   log decimator of the firmware (see log_decimator.h) and prints how many fixes are dropped
+   and how well the kept fixes reconstruct the full track:
+   - cross track: distance of every dropped fix to the line between the kept fixes around it,
+   - along time: distance to the position interpolated by time between them,
+   - the length of both tracks.
+   It also checks that no dropped fix is more than max_interval after the last kept one
+   and returns 1 if it is.
+
+   Usage: log_decimate [options] <GPS_Data_*.csv>...
+          log_decimate [options] --synthetic
+   Options: --distance <m> --heading <degrees> --interval <ms> (default: bicycle_computer_config.h)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include "bicycle_computer_config.h"
+#include "geodesic.h"
+#include "log_decimator.h"
+
+#define MAX_COLUMNS 32
+#define FIX_INTERVAL 500 // ms between two fixes of the full-rate log (interval of log_fix())
+
+struct point_struct
+{
+	uint32_t time; // ms
+	double lat;
+	double lng;
+};
+
+struct params_struct
+{
+	double distance;
+	double heading;
+	uint32_t interval;
+};
+
+// Splits a CSV line in place, returns the number of columns
+static int split_line(char *line, char **columns)
+{
+	int count = 0;
+	char *p = line;
+	while (count < MAX_COLUMNS)
+	{
+		columns[count++] = p;
+		p = strchr(p, ',');
+		if (!p)
+			break;
+		*p++ = '\0';
+	}
+	return count;
+}
+
+// Reads the next CSV line, skipping chunk summaries and padding (see log_chunk.h)
+static bool read_line(FILE *f, char *line, int size)
+{
+	while (fgets(line, size, f))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#' || line[strspn(line, " ")] == '\0')
+			continue;
+		return true;
+	}
+	return false;
+}
+
+static int find_column(char **columns, int count, const char *name)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(columns[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Parses "h:m:s", returns seconds since midnight or -1
+static long parse_time(const char *p)
+{
+	int h, m, s;
+	return sscanf(p, "%d:%d:%d", &h, &m, &s) == 3 ? (h * 60L + m) * 60 + s : -1;
+}
+
+static bool read_track(const char *path, std::vector<point_struct> *track)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "%s: can't open file\n", path);
+		return false;
+	}
+
+	char line[512];
+	char *columns[MAX_COLUMNS];
+	if (!read_line(f, line, sizeof(line)))
+	{
+		fprintf(stderr, "%s: empty file\n", path);
+		fclose(f);
+		return false;
+	}
+	int count = split_line(line, columns);
+	int col_lat = find_column(columns, count, "Latitude");
+	int col_lng = find_column(columns, count, "Longitude");
+	int col_time = find_column(columns, count, "Time");
+	if (col_lat < 0 || col_lng < 0 || col_time < 0)
+	{
+		fprintf(stderr, "%s: no position or time column\n", path);
+		fclose(f);
+		return false;
+	}
+
+	// The CSV only has whole seconds of the day: count the days and spread fixes within the same second
+	long last_second = -1;
+	long day = 0;
+	uint32_t same_second = 0;
+	while (read_line(f, line, sizeof(line)))
+	{
+		count = split_line(line, columns);
+		if (count <= col_lat || count <= col_lng || count <= col_time)
+			continue;
+		long second = parse_time(columns[col_time]);
+		if (second < 0)
+			continue;
+		if (last_second >= 0 && second < last_second)
+			day++;
+		same_second = second == last_second ? same_second + 1 : 0;
+		last_second = second;
+
+		point_struct point;
+		point.time = (day * 86400 + second) * 1000 + same_second * FIX_INTERVAL;
+		point.lat = atof(columns[col_lat]);
+		point.lng = atof(columns[col_lng]);
+		track->push_back(point);
+	}
+	fclose(f);
+	return true;
+}
+
+// Straight roads, gentle curves, switchbacks and a roundabout at 25 km/h with 2 m of GPS noise (no substitute for a recorded ride)
+static void synthetic_track(std::vector<point_struct> *track)
+{
+	std::mt19937 rng(1);
+	std::normal_distribution<double> noise(0, 1);
+	geo_enu_struct enu;
+	geo_enu_init(&enu, 48.137, 11.575);
+
+	// Length (m) and heading change (degrees) of each section
+	static const double sections[][2] = {
+		{3000, 0}, {800, 60}, {2000, 0}, {40, 180}, {150, 0}, {40, -180}, {150, 0}, {40, 180}, {150, 0}, {40, -180},
+		{1000, 0}, {60, 270}, {1500, -30}, {500, 0}, {300, 90}, {2500, 0}};
+	double east = 0, north = 0, heading = 0;
+	double step = 25 / 3.6 * FIX_INTERVAL / 1000.0;
+	uint32_t time = 0;
+	for (size_t s = 0; s < sizeof(sections) / sizeof(sections[0]); s++)
+	{
+		int steps = (int)(sections[s][0] / step);
+		for (int i = 0; i < steps; i++)
+		{
+			heading += sections[s][1] / steps;
+			east += step * sin(heading * GEO_DEG_TO_RAD);
+			north += step * cos(heading * GEO_DEG_TO_RAD);
+			time += FIX_INTERVAL;
+
+			point_struct point;
+			point.time = time;
+			point.lat = enu.lat0 + (north + noise(rng) * 2) / enu.m_per_deg_lat;
+			point.lng = enu.lng0 + (east + noise(rng) * 2) / enu.m_per_deg_lng;
+			track->push_back(point);
+		}
+	}
+}
+
+// Distance (m) of p to the segment a - b and to the point at fraction t of it
+static void segment_errors(const point_struct *a, const point_struct *b, const point_struct *p, double t, double *cross, double *along)
+{
+	geo_enu_struct enu;
+	geo_enu_init(&enu, a->lat, a->lng);
+	double bx, by, px, py;
+	geo_enu_project(&enu, b->lat, b->lng, &bx, &by);
+	geo_enu_project(&enu, p->lat, p->lng, &px, &py);
+
+	double length2 = bx * bx + by * by;
+	double u = length2 > 0 ? (px * bx + py * by) / length2 : 0;
+	u = u < 0 ? 0 : (u > 1 ? 1 : u);
+	*cross = hypot(px - u * bx, py - u * by);
+	*along = hypot(px - t * bx, py - t * by);
+}
+
+static bool report(const char *name, const std::vector<point_struct> &track, const params_struct *params)
+{
+	log_decimator_struct d;
+	log_decimator_init(&d, params->distance, params->heading, LOG_DECIMATION_HEADING_DISTANCE, params->interval);
+	std::vector<size_t> kept;
+	for (size_t i = 0; i < track.size(); i++)
+	{
+		if (log_decimator_keep(&d, track[i].time, track[i].lat, track[i].lng))
+			kept.push_back(i);
+	}
+	if (kept.empty())
+	{
+		printf("%s: no fixes\n", name);
+		return true;
+	}
+
+	double cross_max = 0, cross_sum = 0, cross_sum2 = 0, along_max = 0, along_sum2 = 0;
+	double full_length = 0, kept_length = 0;
+	uint32_t max_gap = 0;
+	unsigned long late = 0;
+	for (size_t i = 1; i < track.size(); i++)
+		full_length += geo_haversine_m(track[i - 1].lat, track[i - 1].lng, track[i].lat, track[i].lng);
+	for (size_t k = 0; k < kept.size(); k++)
+	{
+		const point_struct *a = &track[kept[k]];
+		// After the last kept fix the track ends there
+		const point_struct *b = k + 1 < kept.size() ? &track[kept[k + 1]] : a;
+		size_t end = k + 1 < kept.size() ? kept[k + 1] : track.size();
+		if (b != a)
+		{
+			kept_length += geo_haversine_m(a->lat, a->lng, b->lat, b->lng);
+			if (b->time - a->time > max_gap)
+				max_gap = b->time - a->time;
+		}
+		for (size_t i = kept[k] + 1; i < end; i++)
+		{
+			const point_struct *p = &track[i];
+			double t = b->time > a->time ? (double)(p->time - a->time) / (b->time - a->time) : 0;
+			double cross, along;
+			segment_errors(a, b, p, t, &cross, &along);
+			cross_sum += cross;
+			cross_sum2 += cross * cross;
+			along_sum2 += along * along;
+			cross_max = fmax(cross_max, cross);
+			along_max = fmax(along_max, along);
+			if (p->time - a->time >= params->interval)
+				late++;
+		}
+	}
+
+	unsigned long dropped = track.size() - kept.size();
+	printf("%s: %zu fixes, %zu kept (%.1f%%), %lu dropped, longest gap %.1fs\n", name, track.size(), kept.size(),
+		   100.0 * kept.size() / track.size(), dropped, max_gap / 1000.0);
+	if (dropped > 0)
+	{
+		printf("  cross track error: mean %.2fm  rms %.2fm  max %.2fm\n", cross_sum / dropped, sqrt(cross_sum2 / dropped), cross_max);
+		printf("  along time error:  rms %.2fm  max %.2fm\n", sqrt(along_sum2 / dropped), along_max);
+	}
+	printf("  length: full %.3fkm  kept %.3fkm (%+.2f%%)\n", full_length / 1000, kept_length / 1000,
+		   full_length > 0 ? 100 * (kept_length - full_length) / full_length : 0.0);
+	if (d.kept != kept.size() || d.dropped != dropped)
+	{
+		printf("  FAILED: the decimator counted %u kept and %u dropped\n", d.kept, d.dropped);
+		return false;
+	}
+	if (late > 0)
+	{
+		printf("  FAILED: %lu fixes dropped more than %ums after the last kept fix\n", late, params->interval);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	params_struct params = {LOG_DECIMATION_DISTANCE, LOG_DECIMATION_HEADING, LOG_DECIMATION_MAX_INTERVAL};
+	bool synthetic = false;
+	bool usage = false;
+	std::vector<const char *> files;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--distance") == 0 && i + 1 < argc)
+			params.distance = atof(argv[++i]);
+		else if (strcmp(argv[i], "--heading") == 0 && i + 1 < argc)
+			params.heading = atof(argv[++i]);
+		else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+			params.interval = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--synthetic") == 0)
+			synthetic = true;
+		else if (argv[i][0] != '-')
+			files.push_back(argv[i]);
+		else
+			usage = true;
+	}
+	if (usage || (!synthetic && files.empty()))
+	{
+		fprintf(stderr, "Usage: %s [--distance <m>] [--heading <degrees>] [--interval <ms>] <GPS_Data_*.csv>... | --synthetic\n", argv[0]);
+		return 1;
+	}
+	printf("distance %.1fm, heading %.1f degrees, max. interval %ums\n", params.distance, params.heading, params.interval);
+
+	int errors = 0;
+	if (synthetic)
+	{
+		std::vector<point_struct> track;
+		synthetic_track(&track);
+		if (!report("synthetic", track, &params))
+			errors++;
+	}
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		std::vector<point_struct> track;
+		if (!read_track(files[i], &track) || !report(files[i], track, &params))
+			errors++;
+	}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+/*
+   Log Seek
+   Finds the parts of a chunked GPS_Data_*.csv file (see log_chunk.h) that lie inside
+   a time range and / or an area by reading only the chunk summaries.
+   Only the matching chunks are read completely.
+
+   Usage: log_seek <GPS_Data_*.csv> [--from <time>] [--to <time>] [--bbox <lat min> <lng min> <lat max> <lng max>] [--rows] [--verify]
+   Times are given as YYYY-MM-DDTHH:MM:SS (local time, like the RTC).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log_chunk.h"
+
+// Converts a date and time into seconds since 01.01.2000
+static bool parse_time(const char *text, uint32_t *seconds)
+{
+	static const int days_in_month[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+	int year, month, day, hour = 0, minute = 0, second = 0;
+
+	if (sscanf(text, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) < 3 || year < 2000 || month < 1 || month > 12)
+		return false;
+
+	uint32_t days = day - 1;
+	for (int y = 2000; y < year; y++)
+		days += (y % 4 == 0) ? 366 : 365;
+	for (int m = 1; m < month; m++)
+		days += days_in_month[m - 1] + ((m == 2 && year % 4 == 0) ? 1 : 0);
+
+	*seconds = ((days * 24 + hour) * 60 + minute) * 60 + second;
+	return true;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s <GPS_Data_*.csv> [--from <time>] [--to <time>] [--bbox <lat min> <lng min> <lat max> <lng max>] [--rows] [--verify]\n", name);
+	fprintf(stderr, "Times are given as YYYY-MM-DDTHH:MM:SS\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	uint32_t from = 0, to = 0xFFFFFFFF;
+	bool use_bbox = false, print_rows = false, verify = false;
+	double lat_min = 0, lng_min = 0, lat_max = 0, lng_max = 0;
+
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--from") == 0 && i + 1 < argc && parse_time(argv[i + 1], &from))
+			i++;
+		else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc && parse_time(argv[i + 1], &to))
+			i++;
+		else if (strcmp(argv[i], "--bbox") == 0 && i + 4 < argc)
+		{
+			use_bbox = true;
+			lat_min = atof(argv[++i]);
+			lng_min = atof(argv[++i]);
+			lat_max = atof(argv[++i]);
+			lng_max = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--rows") == 0)
+			print_rows = true;
+		else if (strcmp(argv[i], "--verify") == 0)
+			verify = true;
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f)
+	{
+		fprintf(stderr, "%s: can't open file\n", argv[1]);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	long file_size = ftell(f);
+
+	static char chunk[LOG_CHUNK_SIZE];
+	unsigned long chunks = 0, matches = 0, errors = 0;
+
+	for (long pos = 0; pos < file_size; pos += LOG_CHUNK_SIZE)
+	{
+		log_chunk_struct c;
+		char header[LOG_CHUNK_HEADER_SIZE];
+
+		fseek(f, pos, SEEK_SET);
+		bool valid = fread(header, 1, sizeof(header), f) == sizeof(header);
+		if (valid && pos == 0 && header[0] != '#')
+			continue; // Chunk 0 only holds the CSV header
+		if (!valid || !log_chunk_parse_header(header, &c))
+		{
+			fprintf(stderr, "%s: no chunk summary at offset %ld (not a chunked log?)\n", argv[1], pos);
+			errors++;
+			break;
+		}
+		chunks++;
+
+		// The summary of the last chunk may be older than its data
+		bool last = pos + LOG_CHUNK_SIZE >= file_size;
+		if (!last)
+		{
+			if (c.rows == 0)
+				continue;
+			if (c.last_time < from || c.first_time > to)
+				continue;
+			if (use_bbox && (c.lat_max < lat_min || c.lat_min > lat_max || c.lng_max < lng_min || c.lng_min > lng_max))
+				continue;
+		}
+		matches++;
+
+		if (!print_rows && !verify)
+		{
+			printf("chunk %lu: offset %ld, time %lu..%lu, lat %.5f..%.5f, lng %.5f..%.5f, %.2f..%.2f km, %lu rows%s\n",
+				   (unsigned long)c.index, pos, (unsigned long)c.first_time, (unsigned long)c.last_time,
+				   c.lat_min, c.lat_max, c.lng_min, c.lng_max, c.first_distance, c.last_distance,
+				   (unsigned long)c.rows, last ? " (open)" : "");
+			continue;
+		}
+
+		size_t length = fread(chunk, 1, LOG_CHUNK_DATA_SIZE, f);
+		if (verify && !last)
+		{
+			if (length < c.length || log_crc32(0, chunk, c.length) != c.crc)
+			{
+				printf("chunk %lu: CRC error\n", (unsigned long)c.index);
+				errors++;
+			}
+		}
+		if (print_rows)
+		{
+			fwrite(chunk, 1, last ? length : c.length, stdout);
+		}
+	}
+	fclose(f);
+
+	fprintf(stderr, "%lu of %lu chunks match, %lu errors\n", matches, chunks, errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+/*
+   Ride Index
+   Lists all rides stored in the "rides.idx" file of an SD card (see ride_index.h).
+   Only the index is read, none of the CSV files.
+
+   Usage: ride_index <path to rides.idx>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ride_index.h"
+
+// Converts seconds since 01.01.2000 into a date and time
+static void seconds_to_date(uint32_t seconds, int *year, int *month, int *day, int *hour, int *minute)
+{
+	static const int days_in_month[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+	*minute = (seconds / 60) % 60;
+	*hour = (seconds / 3600) % 24;
+	uint32_t days = seconds / 86400;
+
+	*year = 2000;
+	while (true)
+	{
+		uint32_t days_in_year = (*year % 4 == 0) ? 366 : 365; // Good until 2099, like the RTC
+		if (days < days_in_year)
+			break;
+		days -= days_in_year;
+		(*year)++;
+	}
+	*month = 0;
+	while (true)
+	{
+		uint32_t length = days_in_month[*month] + ((*month == 1 && *year % 4 == 0) ? 1 : 0);
+		if (days < length)
+			break;
+		days -= length;
+		(*month)++;
+	}
+	(*month)++;
+	*day = days + 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <path to %s>\n", argv[0], RIDE_INDEX_FILENAME);
+		return 1;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f)
+	{
+		fprintf(stderr, "%s: can't open file\n", argv[1]);
+		return 1;
+	}
+
+	printf("%-4s %-16s %8s %9s %9s %8s  %s\n", "No.", "Start", "Duration", "Distance", "Max.", "Moving", "File");
+
+	ride_index_entry_struct entry;
+	unsigned int number = 0;
+	double total_distance = 0;
+	uint32_t total_moving = 0;
+	while (fread(&entry, sizeof(entry), 1, f) == 1)
+	{
+		number++;
+		if (entry.magic != RIDE_INDEX_MAGIC)
+		{
+			printf("%-4u (incomplete entry)\n", number);
+			continue;
+		}
+		entry.file_name[RIDE_INDEX_NAME_LENGTH - 1] = '\0';
+
+		int year, month, day, hour, minute;
+		seconds_to_date(entry.start_time, &year, &month, &day, &hour, &minute);
+		uint32_t duration = entry.end_time >= entry.start_time ? entry.end_time - entry.start_time : 0;
+
+		printf("%-4u %02d.%02d.%04d %02d:%02d %4u:%02u %7.2fkm %6.1fkmh %4u:%02u  %s\n",
+			   number, day, month, year, hour, minute,
+			   duration / 3600, (duration / 60) % 60,
+			   entry.distance_km, entry.max_speed,
+			   entry.moving_time / 3600, (entry.moving_time / 60) % 60,
+			   entry.file_name);
+
+		total_distance += entry.distance_km;
+		total_moving += entry.moving_time;
+	}
+	fclose(f);
+
+	printf("%u rides, %.2f km, %u:%02u h moving\n", number, total_distance, total_moving / 3600, (total_moving / 60) % 60);
+	return 0;
+}
@@ -0,0 +1,356 @@
+/*
+   Ride Stats
+   Summarizes many GPS_Data_*.csv files at once: distance, moving time, maximum speed and
+   temperature range per ride, and the same for all rides together.
+
+   - The files are memory mapped and parsed in place, the parser doesn't allocate.
+   - The columns are taken from the CSV header written by init_sd_logger(), so older logs
+     with fewer columns work too. Chunk summaries and padding (see log_chunk.h) are skipped.
+   - The files are spread over all cores, the throughput is printed at the end.
+
+   Usage: ride_stats <GPS_Data_*.csv | directory>... [--threads <n>]
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MAX_COLUMNS 32
+#define MAX_GAP_S 10 // Longer gaps between two rows don't count as moving time
+
+enum column_enum
+{
+	COLUMN_OTHER,
+	COLUMN_TIME,
+	COLUMN_SPEED,
+	COLUMN_TEMPERATURE,
+	COLUMN_DISTANCE
+};
+
+struct ride_struct
+{
+	bool valid;
+	size_t bytes;
+	unsigned long rows;
+	double first_distance;
+	double last_distance;
+	double moving_time_s;
+	double max_speed;
+	double temp_min;
+	double temp_max;
+};
+
+// Column layout of the current firmware, used if a file has no header
+static const column_enum default_columns[] = {COLUMN_OTHER, COLUMN_OTHER, COLUMN_TIME, COLUMN_SPEED, COLUMN_OTHER, COLUMN_TEMPERATURE, COLUMN_OTHER, COLUMN_OTHER, COLUMN_DISTANCE};
+
+// Parses a number like "  48.1234567" or "-3.5", returns NAN for anything else (e.g. "nan")
+static double parse_number(const char *p, const char *end)
+{
+	while (p < end && *p == ' ')
+		p++;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	if (p == end || ((*p < '0' || *p > '9') && *p != '.'))
+		return NAN;
+
+	double value = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		value = value * 10 + (*p++ - '0');
+	if (p < end && *p == '.')
+	{
+		double scale = 0.1;
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale *= 0.1)
+			value += (*p - '0') * scale;
+	}
+	return negative ? -value : value;
+}
+
+// Parses "h:m:s" (not zero padded), returns seconds since midnight or -1
+static long parse_time(const char *p, const char *end)
+{
+	long parts[3] = {0, 0, 0};
+	int part = 0;
+	for (; p < end; p++)
+	{
+		if (*p == ':')
+		{
+			if (++part > 2)
+				return -1;
+		}
+		else if (*p >= '0' && *p <= '9')
+			parts[part] = parts[part] * 10 + (*p - '0');
+		else if (*p != ' ')
+			return -1;
+	}
+	return part == 2 ? (parts[0] * 60 + parts[1]) * 60 + parts[2] : -1;
+}
+
+static void parse_header(const char *p, const char *end, column_enum *columns, int *column_count)
+{
+	*column_count = 0;
+	while (p < end && *column_count < MAX_COLUMNS)
+	{
+		const char *field_end = (const char *)memchr(p, ',', end - p);
+		if (!field_end)
+			field_end = end;
+		size_t length = field_end - p;
+
+		column_enum column = COLUMN_OTHER;
+		if (length == 4 && memcmp(p, "Time", 4) == 0)
+			column = COLUMN_TIME;
+		else if (length == 5 && memcmp(p, "Speed", 5) == 0)
+			column = COLUMN_SPEED;
+		else if (length == 11 && memcmp(p, "Temperature", 11) == 0)
+			column = COLUMN_TEMPERATURE;
+		else if (length == 8 && memcmp(p, "Distance", 8) == 0)
+			column = COLUMN_DISTANCE;
+		columns[(*column_count)++] = column;
+		p = field_end + 1;
+	}
+}
+
+static void process_file(const char *data, size_t size, ride_struct *ride)
+{
+	column_enum columns[MAX_COLUMNS];
+	int column_count = sizeof(default_columns) / sizeof(default_columns[0]);
+	memcpy(columns, default_columns, sizeof(default_columns));
+
+	long last_time = -1;
+	const char *p = data;
+	const char *end = data + size;
+
+	while (p < end)
+	{
+		const char *line_end = (const char *)memchr(p, '\n', end - p);
+		if (!line_end)
+			line_end = end;
+		const char *line = p;
+		p = line_end + 1;
+
+		// Chunk summaries, padding and empty lines
+		if (line == line_end || *line == '#' || *line == '\r' || (*line == ' ' && (line_end - line < 2 || line[1] == ' ')))
+			continue;
+		if (*line == 'L')
+		{ // "Latitude,..."
+			parse_header(line, line_end, columns, &column_count);
+			continue;
+		}
+
+		long time = -1;
+		double speed = NAN, temperature = NAN, distance = NAN;
+		int column = 0;
+		for (const char *field = line; field < line_end && column < column_count; column++)
+		{
+			const char *field_end = (const char *)memchr(field, ',', line_end - field);
+			if (!field_end)
+				field_end = line_end;
+
+			switch (columns[column])
+			{
+			case COLUMN_TIME:
+				time = parse_time(field, field_end);
+				break;
+			case COLUMN_SPEED:
+				speed = parse_number(field, field_end);
+				break;
+			case COLUMN_TEMPERATURE:
+				temperature = parse_number(field, field_end);
+				break;
+			case COLUMN_DISTANCE:
+				distance = parse_number(field, field_end);
+				break;
+			default:
+				break;
+			}
+			field = field_end + 1;
+		}
+
+		ride->rows++;
+		if (!isnan(speed) && speed > ride->max_speed)
+			ride->max_speed = speed;
+		if (!isnan(temperature))
+		{
+			if (!ride->valid || temperature < ride->temp_min)
+				ride->temp_min = temperature;
+			if (!ride->valid || temperature > ride->temp_max)
+				ride->temp_max = temperature;
+		}
+		if (!isnan(distance))
+		{
+			if (isnan(ride->first_distance))
+				ride->first_distance = distance;
+			ride->last_distance = distance;
+		}
+		if (time >= 0)
+		{
+			// Rows are only logged while moving, so short gaps are moving time (also across midnight)
+			long gap = last_time >= 0 ? (time - last_time + 86400) % 86400 : MAX_GAP_S + 1;
+			if (gap <= MAX_GAP_S)
+				ride->moving_time_s += gap;
+			last_time = time;
+		}
+		ride->valid = true;
+	}
+}
+
+static bool map_and_process(const char *path, ride_struct *ride)
+{
+	memset(ride, 0, sizeof(*ride));
+	ride->first_distance = ride->last_distance = NAN;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	ride->bytes = st.st_size;
+	if (st.st_size > 0)
+	{
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+		process_file((const char *)data, st.st_size, ride);
+		munmap(data, st.st_size);
+	}
+	close(fd);
+	return true;
+}
+
+static double ride_distance(const ride_struct *ride)
+{
+	return isnan(ride->first_distance) ? 0 : ride->last_distance - ride->first_distance;
+}
+
+static void add_path(std::vector<std::string> *files, const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+	{
+		DIR *dir = opendir(path);
+		if (!dir)
+			return;
+		std::vector<std::string> entries;
+		while (struct dirent *entry = readdir(dir))
+		{
+			size_t length = strlen(entry->d_name);
+			if (strncmp(entry->d_name, "GPS_Data_", 9) == 0 && length > 4 && strcmp(entry->d_name + length - 4, ".csv") == 0)
+				entries.push_back(std::string(path) + "/" + entry->d_name);
+		}
+		closedir(dir);
+		std::sort(entries.begin(), entries.end());
+		files->insert(files->end(), entries.begin(), entries.end());
+	}
+	else
+	{
+		files->push_back(path);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> files;
+	unsigned threads = std::thread::hardware_concurrency();
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else
+			add_path(&files, argv[i]);
+	}
+	if (files.empty())
+	{
+		fprintf(stderr, "Usage: %s <GPS_Data_*.csv | directory>... [--threads <n>]\n", argv[0]);
+		return 1;
+	}
+	if (threads < 1)
+		threads = 1;
+	if (threads > files.size())
+		threads = files.size();
+
+	// Every thread takes the next file until all are done
+	std::vector<ride_struct> rides(files.size());
+	std::vector<char> ok(files.size());
+	std::atomic<size_t> next(0);
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&]() {
+			for (size_t i = next++; i < files.size(); i = next++)
+				ok[i] = map_and_process(files[i].c_str(), &rides[i]);
+		});
+	}
+	for (auto &worker : workers)
+		worker.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Per ride
+	ride_struct fleet;
+	memset(&fleet, 0, sizeof(fleet));
+	double fleet_distance = 0;
+	unsigned rides_with_data = 0;
+	printf("%-48s %8s %10s %9s %9s %15s\n", "File", "Rows", "Distance", "Moving", "Max.", "Temperature");
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		const ride_struct *ride = &rides[i];
+		if (!ok[i])
+		{
+			printf("%-48s could not be read\n", files[i].c_str());
+			continue;
+		}
+		fleet.bytes += ride->bytes;
+		if (!ride->valid)
+		{
+			printf("%-48s no data\n", files[i].c_str());
+			continue;
+		}
+		printf("%-48s %8lu %8.2fkm %3lu:%02lu:%02lu %5.1fkm/h %6.1f..%5.1fC\n", files[i].c_str(), ride->rows, ride_distance(ride),
+			   (unsigned long)ride->moving_time_s / 3600, ((unsigned long)ride->moving_time_s / 60) % 60, (unsigned long)ride->moving_time_s % 60,
+			   ride->max_speed, ride->temp_min, ride->temp_max);
+
+		fleet.rows += ride->rows;
+		fleet.moving_time_s += ride->moving_time_s;
+		fleet_distance += ride_distance(ride);
+		if (ride->max_speed > fleet.max_speed)
+			fleet.max_speed = ride->max_speed;
+		if (!fleet.valid || ride->temp_min < fleet.temp_min)
+			fleet.temp_min = ride->temp_min;
+		if (!fleet.valid || ride->temp_max > fleet.temp_max)
+			fleet.temp_max = ride->temp_max;
+		fleet.valid = true;
+		rides_with_data++;
+	}
+
+	// All rides
+	printf("\n%u rides, %lu rows, %.2fkm, moving %lu:%02lu:%02lu, max. %.1fkm/h", rides_with_data, fleet.rows, fleet_distance,
+		   (unsigned long)fleet.moving_time_s / 3600, ((unsigned long)fleet.moving_time_s / 60) % 60, (unsigned long)fleet.moving_time_s % 60,
+		   fleet.max_speed);
+	if (fleet.valid)
+		printf(", %.1f..%.1fC", fleet.temp_min, fleet.temp_max);
+	printf("\n%.1fMB in %.3fs (%u threads): %.1fMB/s\n", fleet.bytes / 1e6, seconds, threads, seconds > 0 ? fleet.bytes / 1e6 / seconds : 0);
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+   Telemetry Decode
+   Decodes the binary telemetry stream of the bicycle computer (ENABLE_TELEMETRY, see telemetry.h)
+   and prints every record, or plots the speed and the loop rate live in the terminal.
+
+   Usage: telemetry_decode <serial port | file | -> [--plot]
+   A serial port is set to TELEMETRY_BAUD (921600) 8N1, a file (or stdin) is read as recorded.
+   Example: telemetry_decode /dev/ttyUSB0 --plot
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bicycle_computer_config.h"
+#include "telemetry.h"
+
+#define PLOT_WIDTH 60
+#define PLOT_MAX_SPEED 60.0 // km/h at the right end of the plot
+
+static bool plot = false;
+static unsigned long frames = 0;
+static unsigned long invalid_frames = 0;
+static unsigned long unknown_frames = 0;
+static uint32_t last_loops = 0;
+
+static void print_bar(double value, double max)
+{
+	int length = value <= 0 ? 0 : (int)(value / max * PLOT_WIDTH + 0.5);
+	if (length > PLOT_WIDTH)
+		length = PLOT_WIDTH;
+	putchar('|');
+	for (int i = 0; i < PLOT_WIDTH; i++)
+		putchar(i < length ? '#' : ' ');
+	putchar('|');
+}
+
+static void print_record(uint8_t type, const uint8_t *payload, int length)
+{
+	if (type == TELEMETRY_FIX && length == sizeof(telemetry_fix_struct))
+	{
+		telemetry_fix_struct fix;
+		memcpy(&fix, payload, sizeof(fix));
+		if (plot)
+		{
+			printf("%9.3fs %6.2fkm/h ", fix.time_ms / 1000.0, fix.speed);
+			print_bar(fix.speed, PLOT_MAX_SPEED);
+			printf(" %5u loops/s\n", last_loops);
+		}
+		else
+		{
+			printf("fix     %9.3fs  %.7f,%.7f  %6.2fkm/h  alt %.1fm  course %.0f  dist %.3fkm  grade %+.1f%%  sat %u\n",
+				   fix.time_ms / 1000.0, fix.lat, fix.lng, fix.speed, fix.altitude, fix.course, fix.distance_km, fix.grade, fix.satellites);
+		}
+	}
+	else if (type == TELEMETRY_SENSOR && length == sizeof(telemetry_sensor_struct))
+	{
+		telemetry_sensor_struct sensor;
+		memcpy(&sensor, payload, sizeof(sensor));
+		if (!plot)
+		{
+			printf("sensor  %9.3fs  %.2fC  %.2f%%RH  light %u  backlight %u  battery %.2fV %.0f%% %.1fh\n",
+				   sensor.time_ms / 1000.0, sensor.temperature, sensor.humidity, sensor.light, sensor.backlight,
+				   sensor.battery_voltage, sensor.battery_soc, sensor.battery_runtime_h);
+		}
+	}
+	else if (type == TELEMETRY_PROFILE && length == sizeof(telemetry_profile_struct))
+	{
+		telemetry_profile_struct profile;
+		memcpy(&profile, payload, sizeof(profile));
+		last_loops = profile.loops;
+		if (!plot)
+		{
+			printf("profile %9.3fs  %u loops  ui %uus + %uus  lcd %uus  heap %u  backlog %u  sd %u  screen %u  dropped log %u / telemetry %u  gps %u chars (%u failed)\n",
+				   profile.time_ms / 1000.0, profile.loops, profile.ui_compose_us, profile.ui_queue_us, profile.lcd_send_us,
+				   profile.free_heap, profile.backlog_rows, profile.sd_state, profile.screen, profile.log_dropped,
+				   profile.telemetry_dropped, profile.gps_chars, profile.gps_failed_checksum);
+		}
+	}
+	else if (type == TELEMETRY_LOG && length == sizeof(telemetry_log_struct))
+	{
+		telemetry_log_struct log;
+		memcpy(&log, payload, sizeof(log));
+		if (!plot)
+		{
+			printf("log     %9.3fs  level %u  id %u  %ld %ld %ld %ld\n",
+				   log.time_ms / 1000.0, log.level, log.id, (long)log.args[0], (long)log.args[1], (long)log.args[2], (long)log.args[3]);
+		}
+	}
+	else
+	{
+		unknown_frames++;
+	}
+}
+
+// Configures a serial port, does nothing for files and pipes
+static void setup_port(int fd)
+{
+	struct termios tty;
+	if (!isatty(fd) || tcgetattr(fd, &tty) != 0)
+		return;
+
+	cfmakeraw(&tty);
+	cfsetispeed(&tty, B921600);
+	cfsetospeed(&tty, B921600);
+	tty.c_cflag |= CLOCAL | CREAD;
+	tty.c_cc[VMIN] = 1;
+	tty.c_cc[VTIME] = 0;
+	if (tcsetattr(fd, TCSANOW, &tty) != 0)
+		fprintf(stderr, "Could not set the serial port to %d baud\n", TELEMETRY_BAUD);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "--plot") != 0))
+	{
+		fprintf(stderr, "Usage: %s <serial port | file | -> [--plot]\n", argv[0]);
+		return 1;
+	}
+	plot = argc == 3;
+
+	int fd = strcmp(argv[1], "-") == 0 ? 0 : open(argv[1], O_RDONLY | O_NOCTTY);
+	if (fd < 0)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	setup_port(fd);
+
+	// Collect the bytes between two delimiters
+	uint8_t frame[TELEMETRY_MAX_FRAME];
+	size_t frame_length = 0;
+	bool overflow = false;
+	uint8_t buffer[4096];
+	uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+	ssize_t n;
+
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (ssize_t i = 0; i < n; i++)
+		{
+			if (buffer[i] != 0)
+			{
+				if (frame_length < sizeof(frame))
+					frame[frame_length++] = buffer[i];
+				else
+					overflow = true; // Text or garbage
+				continue;
+			}
+
+			if (frame_length > 0)
+			{
+				uint8_t type;
+				int length = overflow ? -1 : telemetry_parse(frame, frame_length, &type, payload);
+				if (length < 0)
+				{
+					invalid_frames++;
+				}
+				else
+				{
+					frames++;
+					print_record(type, payload, length);
+				}
+			}
+			frame_length = 0;
+			overflow = false;
+		}
+		fflush(stdout);
+	}
+
+	fprintf(stderr, "%lu frames, %lu invalid (text, CRC), %lu unknown\n", frames, invalid_frames, unknown_frames);
+	if (fd != 0)
+		close(fd);
+	return 0;
+}
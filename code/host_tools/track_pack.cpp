@@ -0,0 +1,346 @@
+/*
+   Track Pack
+   Compresses recorded rides with the track codec of the firmware (see track_codec.h),
+   checks that every fix decodes to the same CSV row and reports the compression ratio
+   and the CPU time per fix, with and without the LZ stage.
+   It also decodes the *.trk files written with ENABLE_TRACK_COMPRESSION back to CSV.
+
+   Usage: track_pack <GPS_Data_*.csv>...
+          track_pack --synthetic [fixes]
+          track_pack --decode <GPS_Data_*.trk>
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bicycle_computer_config.h"
+#include "track_codec.h"
+
+#define MAX_COLUMNS 32
+#define MAX_LINE 1024
+
+// Names of the CSV columns (see init_sd_logger())
+static const char *const field_names[TRACK_FIELDS] = {"Time", "Latitude", "Longitude", "Speed", "Satellites", "Temperature", "Humidity",
+													  "Light", "Distance", "Altitude", "Ascent", "Descent", "Grade", "Battery"};
+
+struct ride_struct
+{
+	std::vector<track_fix_struct> fixes;
+	std::vector<std::string> rows; // Original rows (only if the file has all columns)
+	size_t row_bytes;
+};
+
+struct result_struct
+{
+	size_t bytes;
+	size_t blocks;
+	double encode_s;
+	double decode_s;
+	unsigned long mismatches;
+};
+
+// Parses "h:m:s", returns seconds since midnight or -1
+static long parse_time(const char *p)
+{
+	int h, m, s;
+	return sscanf(p, "%d:%d:%d", &h, &m, &s) == 3 ? (h * 60L + m) * 60 + s : -1;
+}
+
+static bool read_ride(const char *path, ride_struct *ride)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return false;
+	}
+
+	int columns[MAX_COLUMNS]; // Field of each column (-1 = unknown)
+	int column_count = 0;
+	bool complete = false; // All fields are in the file
+	long last_time = -1;
+	long day = 0;
+	char line[MAX_LINE];
+	while (fgets(line, sizeof(line), f))
+	{
+		if (line[0] == '#' || line[0] == ' ' || line[0] == '\r' || line[0] == '\n')
+			continue; // Chunk summaries, padding
+		if (line[0] == 'L')
+		{ // Header
+			column_count = 0;
+			int found = 0;
+			for (char *field = strtok(line, ",\r\n"); field && column_count < MAX_COLUMNS; field = strtok(NULL, ",\r\n"))
+			{
+				columns[column_count] = -1;
+				for (int i = 0; i < TRACK_FIELDS; i++)
+				{
+					if (strcmp(field, field_names[i]) == 0)
+					{
+						columns[column_count] = i;
+						found++;
+					}
+				}
+				column_count++;
+			}
+			complete = found == TRACK_FIELDS;
+			continue;
+		}
+		if (column_count == 0)
+			continue;
+
+		track_fix_struct fix;
+		memset(&fix, 0, sizeof(fix));
+		std::string row = line;
+		char *p = line;
+		for (int column = 0; column < column_count && p; column++)
+		{
+			char *end = strchr(p, ',');
+			if (end)
+				*end = '\0';
+			int field = columns[column];
+			if (field == TRACK_TIME)
+			{
+				// The CSV only has the GPS time of day, count the days and add the time zone like the firmware
+				long time = parse_time(p);
+				if (time >= 0)
+				{
+					if (last_time >= 0 && time < last_time)
+						day++;
+					last_time = time;
+					fix.value[TRACK_TIME] = day * 86400 + time + UTC_ADJ * 3600;
+				}
+			}
+			else if (field >= 0)
+			{
+				// Empty fields (temperature and humidity before the sensor started) are stored as TRACK_NAN
+				char *number_end;
+				double value = strtod(p, &number_end);
+				track_fix_set(&fix, (track_field_enum)field, number_end == p ? NAN : value);
+			}
+			p = end ? end + 1 : NULL;
+		}
+		ride->fixes.push_back(fix);
+		ride->row_bytes += row.size();
+		if (complete)
+			ride->rows.push_back(row);
+	}
+	fclose(f);
+	return true;
+}
+
+// Ride at ~20km/h with GPS noise, slowly changing sensors and a few stops (no substitute for a recorded ride)
+static void synthetic_ride(size_t count, ride_struct *ride)
+{
+	std::mt19937 rng(1);
+	std::normal_distribution<double> noise(0, 1);
+	double lat = 48.137, lng = 11.575, heading = 0, speed = 20, altitude = 520, ascent = 0, descent = 0, distance = 0;
+	double temperature = 18, humidity = 55, battery = 4.1, grade = 0;
+	int light = 1200;
+	uint32_t time = 610000000;
+	for (size_t i = 0; i < count; i++)
+	{
+		time++;
+		bool stopped = (i / 600) % 10 == 9 && i % 600 < 60; // One minute every 100 minutes
+		speed = stopped ? 0 : fmax(5, fmin(40, speed + noise(rng) * 0.5));
+		heading += noise(rng) * 3;
+		double step = speed / 3.6;
+		lat += step * cos(heading * M_PI / 180) / 111195.0 + noise(rng) * 2e-6;
+		lng += step * sin(heading * M_PI / 180) / (111195.0 * cos(lat * M_PI / 180)) + noise(rng) * 2e-6;
+		distance += step / 1000;
+		double climb = noise(rng) * 0.3;
+		altitude += climb;
+		(climb > 0 ? ascent : descent) += fabs(climb);
+		if (i % 10 == 0)
+		{ // Sensors and the grade window change slower than the position
+			temperature += noise(rng) * 0.05;
+			humidity += noise(rng) * 0.1;
+			light += (int)(noise(rng) * 20);
+			grade = fmax(-15, fmin(15, grade + noise(rng)));
+		}
+		battery -= 0.00002;
+
+		track_fix_struct fix;
+		fix.value[TRACK_TIME] = time;
+		track_fix_set(&fix, TRACK_LAT, lat);
+		track_fix_set(&fix, TRACK_LNG, lng);
+		track_fix_set(&fix, TRACK_SPEED, speed);
+		track_fix_set(&fix, TRACK_SATELLITES, 9 + (i / 300) % 3);
+		track_fix_set(&fix, TRACK_TEMPERATURE, temperature);
+		track_fix_set(&fix, TRACK_HUMIDITY, humidity);
+		track_fix_set(&fix, TRACK_LIGHT, light);
+		track_fix_set(&fix, TRACK_DISTANCE, distance);
+		track_fix_set(&fix, TRACK_ALTITUDE, altitude);
+		track_fix_set(&fix, TRACK_ASCENT, ascent);
+		track_fix_set(&fix, TRACK_DESCENT, descent);
+		track_fix_set(&fix, TRACK_GRADE, grade);
+		track_fix_set(&fix, TRACK_BATTERY, battery);
+
+		char row[MAX_LINE];
+		track_format_row(&fix, UTC_ADJ * 3600, row, sizeof(row));
+		ride->fixes.push_back(fix);
+		ride->rows.push_back(row);
+		ride->row_bytes += strlen(row);
+	}
+}
+
+static result_struct compress(const ride_struct *ride, bool lz)
+{
+	result_struct result;
+	memset(&result, 0, sizeof(result));
+	std::vector<uint8_t> file;
+	track_encoder_struct encoder;
+
+	auto start = std::chrono::steady_clock::now();
+	track_encoder_init(&encoder, lz);
+	for (const track_fix_struct &fix : ride->fixes)
+	{
+		if (!track_encoder_add(&encoder, &fix))
+		{
+			const uint8_t *block = track_encoder_block(&encoder);
+			file.insert(file.end(), block, block + TRACK_BLOCK_SIZE);
+			track_encoder_next_block(&encoder);
+			track_encoder_add(&encoder, &fix);
+		}
+	}
+	if (encoder.fixes > 0)
+	{
+		const uint8_t *block = track_encoder_block(&encoder);
+		file.insert(file.end(), block, block + TRACK_BLOCK_SIZE);
+	}
+	result.encode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.bytes = file.size();
+	result.blocks = file.size() / TRACK_BLOCK_SIZE;
+
+	// Decode and compare
+	std::vector<track_fix_struct> decoded;
+	track_fix_struct fixes[TRACK_BLOCK_MAX_FIXES];
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < result.blocks; i++)
+	{
+		int count = track_decode_block(&file[i * TRACK_BLOCK_SIZE], fixes, TRACK_BLOCK_MAX_FIXES);
+		if (count > 0)
+			decoded.insert(decoded.end(), fixes, fixes + count);
+	}
+	result.decode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (decoded.size() != ride->fixes.size())
+		result.mismatches = ride->fixes.size();
+	for (size_t i = 0; i < decoded.size() && i < ride->fixes.size(); i++)
+	{
+		if (memcmp(&decoded[i], &ride->fixes[i], sizeof(track_fix_struct)) != 0)
+			result.mismatches++;
+	}
+	return result;
+}
+
+// Rows that are formatted differently after the round trip (rounding of the CSV precision)
+static unsigned long row_differences(const ride_struct *ride)
+{
+	unsigned long differences = 0;
+	char row[MAX_LINE];
+	for (size_t i = 0; i < ride->rows.size(); i++)
+	{
+		track_format_row(&ride->fixes[i], UTC_ADJ * 3600, row, sizeof(row));
+		// Rows end with "\r\n" on some files
+		const std::string &original = ride->rows[i];
+		size_t length = original.find_last_not_of("\r\n") + 1;
+		if (strncmp(row, original.c_str(), length) != 0 || row[length] != '\n')
+			differences++;
+	}
+	return differences;
+}
+
+static bool report(const char *name, const ride_struct *ride)
+{
+	size_t n = ride->fixes.size();
+	if (n == 0)
+	{
+		printf("%s: no fixes\n", name);
+		return true;
+	}
+	printf("%s: %zu fixes, %zu bytes of CSV rows (%.1f per fix)\n", name, n, ride->row_bytes, (double)ride->row_bytes / n);
+	if (!ride->rows.empty())
+		printf("  rows that differ after decoding: %lu\n", row_differences(ride));
+
+	bool ok = true;
+	for (int lz = 0; lz <= 1; lz++)
+	{
+		result_struct r = compress(ride, lz);
+		printf("  %-9s %8zu bytes in %4zu blocks, %5.2f bytes per fix, ratio %5.1f:1, encode %6.0fns / decode %4.0fns per fix%s\n",
+			   lz ? "delta+LZ" : "delta", r.bytes, r.blocks, (double)r.bytes / n, (double)ride->row_bytes / r.bytes,
+			   r.encode_s / n * 1e9, r.decode_s / n * 1e9, r.mismatches ? "  DECODING FAILED" : "");
+		ok &= r.mismatches == 0;
+	}
+	return ok;
+}
+
+static int decode_file(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+	{
+		perror(path);
+		return 1;
+	}
+	printf("Latitude,Longitude,Time,Speed,Satellites,Temperature,Humidity,Light,Distance,Altitude,Ascent,Descent,Grade,Battery,\n");
+	uint8_t block[TRACK_BLOCK_SIZE];
+	track_fix_struct fixes[TRACK_BLOCK_MAX_FIXES];
+	unsigned long blocks = 0, damaged = 0;
+	char row[MAX_LINE];
+	while (fread(block, 1, sizeof(block), f) == sizeof(block))
+	{
+		blocks++;
+		int count = track_decode_block(block, fixes, TRACK_BLOCK_MAX_FIXES);
+		if (count < 0)
+		{
+			damaged++;
+			continue;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			track_format_row(&fixes[i], UTC_ADJ * 3600, row, sizeof(row));
+			fputs(row, stdout);
+		}
+	}
+	fclose(f);
+	fprintf(stderr, "%lu blocks, %lu empty or damaged\n", blocks, damaged);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 3 && strcmp(argv[1], "--decode") == 0)
+		return decode_file(argv[2]);
+	if (argc < 2 || strcmp(argv[1], "--decode") == 0)
+	{
+		fprintf(stderr, "Usage: %s <GPS_Data_*.csv>... | --synthetic [fixes] | --decode <GPS_Data_*.trk>\n", argv[0]);
+		return 1;
+	}
+
+	bool ok = true;
+	if (strcmp(argv[1], "--synthetic") == 0)
+	{
+		ride_struct ride = ride_struct();
+		synthetic_ride(argc > 2 ? strtoul(argv[2], NULL, 10) : 4 * 3600, &ride);
+		ok &= report("synthetic", &ride);
+	}
+	else
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			ride_struct ride = ride_struct();
+			if (read_ride(argv[i], &ride))
+				ok &= report(argv[i], &ride);
+			else
+				ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/*
+   Track Replay
+   Replays a GPS_Data_*.csv file from the SD card through the firmware's
+   climb analytics and prints total ascent, descent and the grade range.
+
+   Usage: track_replay <GPS_Data_*.csv> [...]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bicycle_computer_config.h"
+#include "climb_analytics.h"
+
+#define MAX_COLUMNS 32
+
+// Same formula as TinyGPSPlus::distanceBetween()
+static double distance_between(double lat1, double long1, double lat2, double long2)
+{
+	double delta = (long1 - long2) * M_PI / 180.0;
+	double sdlong = sin(delta);
+	double cdlong = cos(delta);
+	lat1 = lat1 * M_PI / 180.0;
+	lat2 = lat2 * M_PI / 180.0;
+	double slat1 = sin(lat1);
+	double clat1 = cos(lat1);
+	double slat2 = sin(lat2);
+	double clat2 = cos(lat2);
+	delta = (clat1 * slat2) - (slat1 * clat2 * cdlong);
+	delta = delta * delta;
+	delta += (clat2 * sdlong) * (clat2 * sdlong);
+	delta = sqrt(delta);
+	double denom = (slat1 * slat2) + (clat1 * clat2 * cdlong);
+	delta = atan2(delta, denom);
+	return delta * 6372795;
+}
+
+// Splits a CSV line in place, returns the number of columns
+static int split_line(char *line, char **columns)
+{
+	int count = 0;
+	char *p = line;
+	while (count < MAX_COLUMNS)
+	{
+		columns[count++] = p;
+		p = strchr(p, ',');
+		if (!p)
+			break;
+		*p++ = '\0';
+	}
+	return count;
+}
+
+// Reads the next CSV line, skipping chunk summaries and padding (see log_chunk.h)
+static bool read_line(FILE *f, char *line, int size)
+{
+	while (fgets(line, size, f))
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '#' || line[strspn(line, " ")] == '\0')
+			continue;
+		return true;
+	}
+	return false;
+}
+
+static int find_column(char **columns, int count, const char *name)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(columns[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static bool replay_file(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "%s: can't open file\n", path);
+		return false;
+	}
+
+	char line[512];
+	char *columns[MAX_COLUMNS];
+
+	// Header
+	if (!read_line(f, line, sizeof(line)))
+	{
+		fprintf(stderr, "%s: empty file\n", path);
+		fclose(f);
+		return false;
+	}
+	int count = split_line(line, columns);
+	int col_lat = find_column(columns, count, "Latitude");
+	int col_lng = find_column(columns, count, "Longitude");
+	int col_alt = find_column(columns, count, "Altitude");
+	int col_ascent = find_column(columns, count, "Ascent");
+	if (col_lat < 0 || col_lng < 0 || col_alt < 0)
+	{
+		fprintf(stderr, "%s: no altitude data (logged by an older firmware?)\n", path);
+		fclose(f);
+		return false;
+	}
+
+	climb_struct climb;
+	climb_init(&climb, CLIMB_ALT_DEADBAND, CLIMB_ALT_FILTER, CLIMB_SAMPLE_SPACING, CLIMB_MIN_WINDOW);
+
+	double distance_m = 0;
+	double last_lat = 0, last_lng = 0;
+	double logged_ascent = -1;
+	double min_grade = 0, max_grade = 0;
+	unsigned long rows = 0;
+
+	while (read_line(f, line, sizeof(line)))
+	{
+		count = split_line(line, columns);
+		if (count <= col_alt || count <= col_lat || count <= col_lng)
+			continue;
+
+		double lat = atof(columns[col_lat]);
+		double lng = atof(columns[col_lng]);
+		if (rows > 0)
+			distance_m += distance_between(last_lat, last_lng, lat, lng);
+		last_lat = lat;
+		last_lng = lng;
+
+		climb_update(&climb, distance_m, atof(columns[col_alt]));
+		if (climb.grade < min_grade)
+			min_grade = climb.grade;
+		if (climb.grade > max_grade)
+			max_grade = climb.grade;
+
+		if (col_ascent >= 0 && count > col_ascent)
+			logged_ascent = atof(columns[col_ascent]);
+		rows++;
+	}
+	fclose(f);
+
+	printf("%s: %lu fixes, %.2f km, ascent %.0f m, descent %.0f m, grade %+.1f%%..%+.1f%%",
+		   path, rows, distance_m / 1000.0, climb.total_ascent, climb.total_descent, min_grade, max_grade);
+	if (logged_ascent >= 0)
+		printf(" (device: ascent %.0f m)", logged_ascent);
+	printf("\n");
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <GPS_Data_*.csv> [...]\n", argv[0]);
+		return 1;
+	}
+
+	int errors = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!replay_file(argv[i]))
+			errors++;
+	}
+	return errors ? 1 : 0;
+}